@@ -0,0 +1,457 @@
+#pragma once
+// Price feed of Apache Arrow IPC files (Feather v2). Needs Arrow: define BK_WITH_ARROW and link
+// libarrow, this header is not included by Cerebro.hpp.
+
+#ifndef BK_WITH_ARROW
+#error "ArrowData.hpp needs Apache Arrow, define BK_WITH_ARROW and link libarrow."
+#endif
+
+#include "DataFeeds.hpp"
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/reader.h>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace backtradercpp {
+    namespace feeds {
+        // Price feed of an Arrow IPC file. The file is memory mapped and columns are read in place, a
+        // bar only copies its own values. Rows must be sorted by time. The time column may be a
+        // timestamp, a date or a string parsed by time_converter, prices may be double, float, int32 or
+        // int64 columns. Adjusted prices are raw prices, or computed by adj_factors().
+        class ArrowDataImpl : public BasePriceDataImpl {
+        public:
+            // Long format: a row per asset and time. Columns are found by names in tcohlcv_map, volume
+            // may be "". Other numeric columns are extra columns, e.g. data(0).num("pe"), and assets
+            // without a row at a time are invalid.
+            ArrowDataImpl(const std::string& file, std::array<std::string, 7> tcohlcv_map,
+                TimeParser time_converter = nullptr);
+            // Wide format: a row per time, with a column of prices per asset named by its code. As in
+            // CSVTabDataImpl, OHLC are the same value and volume is implicitly very large.
+            ArrowDataImpl(const std::string& file, const std::string& time_col,
+                TimeParser time_converter = nullptr);
+
+            bool read() override;
+            void reset() override;
+            void seek(const ptime& time, int history) override;
+            std::shared_ptr<BasePriceDataImpl> clone() override;
+
+        private:
+            // A numeric column of a record batch, read in place. Nulls are NaN.
+            class NumColumn {
+            public:
+                NumColumn() = default;
+                explicit NumColumn(std::shared_ptr<arrow::Array> array);
+                static bool supports(const arrow::DataType& type);
+
+                bool empty() const { return array_ == nullptr; }
+                double operator[](int64_t row) const;
+
+            private:
+                std::shared_ptr<arrow::Array> array_ = nullptr;
+                arrow::Type::type type_ = arrow::Type::NA;
+                const void* values_ = nullptr;
+            };
+            struct Batch {
+                std::shared_ptr<arrow::RecordBatch> batch;
+                // Long format: open, high, low, close, volume and extra columns. Wide format: assets.
+                std::vector<NumColumn> cols;
+                std::vector<int> assets; // Long format: asset of each row.
+            };
+            // First row of a bar.
+            struct BarPos {
+                int64_t time; // Microseconds since epoch.
+                int batch;
+                int64_t row;
+            };
+
+            void open_(const std::string& file);
+            int column_(const std::string& name, bool numeric) const;
+            // Time of a row in microseconds since epoch.
+            int64_t time_(const arrow::Array& col, int64_t row) const;
+            // Find columns, assets and bars.
+            void index_(const std::string& time_col, const std::array<std::string, 7>* tcohlcv_map);
+            void read_long_();
+            void read_wide_();
+
+            std::string file_name_;
+            std::shared_ptr<arrow::Schema> arrow_schema_;
+            std::vector<Batch> batches_;
+            std::vector<BarPos> bars_;
+            bool wide_ = false;
+            int bar_ = 0;               // Next bar.
+            std::vector<int> printed_; // Assets of last bar, long format.
+        };
+
+        // A price feed of an Arrow IPC file, see ArrowDataImpl. E.g. ArrowPriceData("prices.arrow")
+        // for a long file with columns time, code, open, high, low, close and volume, or
+        // ArrowPriceData("close.arrow", "date") for a wide file.
+        struct ArrowPriceData : BasePriceDataFeed {
+            std::shared_ptr<ArrowDataImpl> sp;
+
+            ArrowPriceData(const std::string& file,
+                std::array<std::string, 7> tcohlcv_map = { "time", "code", "open", "high", "low", "close",
+                    "volume" },
+                TimeParser time_converter = nullptr)
+                : sp(std::make_shared<ArrowDataImpl>(file, tcohlcv_map, time_converter)) {
+                set_base_sp();
+            }
+            ArrowPriceData(const std::string& file, const std::string& time_col,
+                TimeParser time_converter = nullptr)
+                : sp(std::make_shared<ArrowDataImpl>(file, time_col, time_converter)) {
+                set_base_sp();
+            }
+            explicit ArrowPriceData(std::shared_ptr<ArrowDataImpl> sp) : sp(std::move(sp)) {
+                set_base_sp();
+            }
+
+            ArrowPriceData& set_adj_factors(const CSVEventData& factors) {
+                sp->adj_factors(factors.sp);
+                return *this;
+            }
+
+            ArrowPriceData& set_name(const std::string& name) {
+                BasePriceDataFeed::set_name(name);
+                return *this;
+            }
+
+            void set_base_sp() { BasePriceDataFeed::sp = sp; }
+            BasePriceDataFeed clone() {
+                return ArrowPriceData(std::static_pointer_cast<ArrowDataImpl>(sp->clone()));
+            }
+        };
+
+        namespace detail {
+            template <typename T> T arrow_value(arrow::Result<T> res, const std::string& what) {
+                if (!res.ok()) {
+                    throw std::runtime_error(what + ": " + res.status().ToString());
+                }
+                return std::move(res).ValueUnsafe();
+            }
+        } // namespace detail
+
+        inline ArrowDataImpl::NumColumn::NumColumn(std::shared_ptr<arrow::Array> array)
+            : array_(std::move(array)), type_(array_->type_id()) {
+            switch (type_) {
+            case arrow::Type::DOUBLE:
+                values_ = std::static_pointer_cast<arrow::DoubleArray>(array_)->raw_values();
+                break;
+            case arrow::Type::FLOAT:
+                values_ = std::static_pointer_cast<arrow::FloatArray>(array_)->raw_values();
+                break;
+            case arrow::Type::INT32:
+                values_ = std::static_pointer_cast<arrow::Int32Array>(array_)->raw_values();
+                break;
+            case arrow::Type::INT64:
+                values_ = std::static_pointer_cast<arrow::Int64Array>(array_)->raw_values();
+                break;
+            default:
+                throw std::invalid_argument("Column type " + array_->type()->ToString() +
+                    " is not numeric.");
+            }
+        }
+
+        inline bool ArrowDataImpl::NumColumn::supports(const arrow::DataType& type) {
+            auto id = type.id();
+            return id == arrow::Type::DOUBLE || id == arrow::Type::FLOAT || id == arrow::Type::INT32 ||
+                id == arrow::Type::INT64;
+        }
+
+        inline double ArrowDataImpl::NumColumn::operator[](int64_t row) const {
+            if (array_->null_count() > 0 && array_->IsNull(row)) {
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+            switch (type_) {
+            case arrow::Type::DOUBLE:
+                return static_cast<const double*>(values_)[row];
+            case arrow::Type::FLOAT:
+                return static_cast<const float*>(values_)[row];
+            case arrow::Type::INT32:
+                return static_cast<const int32_t*>(values_)[row];
+            default:
+                return static_cast<double>(static_cast<const int64_t*>(values_)[row]);
+            }
+        }
+
+        inline ArrowDataImpl::ArrowDataImpl(const std::string& file,
+            std::array<std::string, 7> tcohlcv_map, TimeParser time_converter)
+            : BasePriceDataImpl(time_converter) {
+            open_(file);
+            index_(tcohlcv_map[0], &tcohlcv_map);
+        }
+
+        inline ArrowDataImpl::ArrowDataImpl(const std::string& file, const std::string& time_col,
+            TimeParser time_converter)
+            : BasePriceDataImpl(time_converter), wide_(true) {
+            open_(file);
+            index_(time_col, nullptr);
+        }
+
+        inline std::shared_ptr<BasePriceDataImpl> ArrowDataImpl::clone() {
+            // Batches are immutable and shared.
+            auto res = std::make_shared<ArrowDataImpl>(*this);
+            res->reset();
+            return res;
+        }
+
+        inline void ArrowDataImpl::open_(const std::string& file) {
+            print(fg(fmt::color::yellow), "Reading asset pricing data in {}\n", file);
+            util::check_path_exists(file);
+            file_name_ = file;
+            auto mapped = detail::arrow_value(
+                arrow::io::MemoryMappedFile::Open(file, arrow::io::FileMode::READ),
+                "Can't map file " + file);
+            auto reader = detail::arrow_value(arrow::ipc::RecordBatchFileReader::Open(mapped),
+                file + " is not an Arrow IPC file");
+            arrow_schema_ = reader->schema();
+            for (int k = 0; k < reader->num_record_batches(); ++k) {
+                // Buffers of batches point into the mapping, which they keep alive.
+                auto batch = detail::arrow_value(reader->ReadRecordBatch(k),
+                    "Can't read record batch of " + file);
+                if (batch->num_rows() > 0) {
+                    batches_.push_back({ std::move(batch) });
+                }
+            }
+        }
+
+        inline int ArrowDataImpl::column_(const std::string& name, bool numeric) const {
+            int col = arrow_schema_->GetFieldIndex(name);
+            if (col < 0) {
+                throw std::invalid_argument("No column " + name + " in " + file_name_ + ".");
+            }
+            if (numeric && !NumColumn::supports(*arrow_schema_->field(col)->type())) {
+                throw std::invalid_argument("Column " + name + " of " + file_name_ + " is " +
+                    arrow_schema_->field(col)->type()->ToString() + ", not a number.");
+            }
+            return col;
+        }
+
+        inline int64_t ArrowDataImpl::time_(const arrow::Array& col, int64_t row) const {
+            switch (col.type_id()) {
+            case arrow::Type::TIMESTAMP: {
+                int64_t v = static_cast<const arrow::TimestampArray&>(col).Value(row);
+                switch (static_cast<const arrow::TimestampType&>(*col.type()).unit()) {
+                case arrow::TimeUnit::SECOND:
+                    return v * 1'000'000;
+                case arrow::TimeUnit::MILLI:
+                    return v * 1'000;
+                case arrow::TimeUnit::MICRO:
+                    return v;
+                default:
+                    return v / 1'000;
+                }
+            }
+            case arrow::Type::DATE32:
+                return int64_t(static_cast<const arrow::Date32Array&>(col).Value(row)) * 86'400'000'000;
+            case arrow::Type::DATE64:
+                return static_cast<const arrow::Date64Array&>(col).Value(row) * 1'000;
+            case arrow::Type::STRING:
+                return util::to_epoch_us(time_converter_.parse(
+                    static_cast<const arrow::StringArray&>(col).GetView(row)));
+            case arrow::Type::LARGE_STRING:
+                return util::to_epoch_us(time_converter_.parse(
+                    static_cast<const arrow::LargeStringArray&>(col).GetView(row)));
+            default:
+                throw std::invalid_argument("Time column of " + file_name_ + " is " +
+                    col.type()->ToString() + ", not a timestamp, date or string.");
+            }
+        }
+
+        inline void ArrowDataImpl::index_(const std::string& time_col,
+            const std::array<std::string, 7>* tcohlcv_map) {
+            int time = column_(time_col, false);
+            // Columns of Batch::cols.
+            std::vector<int> cols;
+            int code = -1;
+            auto schema = std::make_shared<FieldSchema>();
+            if (wide_) {
+                for (int c = 0; c < arrow_schema_->num_fields(); ++c) {
+                    if (c != time && NumColumn::supports(*arrow_schema_->field(c)->type())) {
+                        cols.push_back(c);
+                        codes_.push_back(arrow_schema_->field(c)->name());
+                    }
+                }
+            }
+            else {
+                const auto& names = *tcohlcv_map;
+                code = column_(names[1], false);
+                for (int j = 2; j < 7; ++j) {
+                    cols.push_back(names[j].empty() ? -1 : column_(names[j], true));
+                }
+                for (int c = 0; c < arrow_schema_->num_fields(); ++c) {
+                    if (c != time && c != code && std::find(cols.begin(), cols.end(), c) == cols.end() &&
+                        NumColumn::supports(*arrow_schema_->field(c)->type())) {
+                        cols.push_back(c);
+                        schema->add_num(arrow_schema_->field(c)->name());
+                    }
+                }
+            }
+
+            std::unordered_map<std::string, int> asset_index;
+            auto asset_of = [&](std::string_view s) {
+                auto [it, added] = asset_index.try_emplace(std::string(s), int(codes_.size()));
+                if (added) {
+                    codes_.emplace_back(s);
+                }
+                return it->second;
+            };
+            int64_t last = std::numeric_limits<int64_t>::min();
+            for (int b = 0; b < static_cast<int>(batches_.size()); ++b) {
+                auto& batch = batches_[b];
+                for (int c : cols) {
+                    batch.cols.push_back(c < 0 ? NumColumn() : NumColumn(batch.batch->column(c)));
+                }
+                const auto& times = *batch.batch->column(time);
+                int64_t rows = batch.batch->num_rows();
+                for (int64_t r = 0; r < rows; ++r) {
+                    int64_t t = time_(times, r);
+                    if (t < last) {
+                        throw std::invalid_argument("Rows of " + file_name_ + " are not sorted by time.");
+                    }
+                    if (t != last) {
+                        bars_.push_back({ t, b, r });
+                        last = t;
+                    }
+                }
+                if (wide_) {
+                    continue;
+                }
+                // Assets of rows, dictionary codes are looked up once.
+                auto codes = batch.batch->column(code);
+                batch.assets.resize(rows);
+                switch (codes->type_id()) {
+                case arrow::Type::STRING: {
+                    const auto& a = static_cast<const arrow::StringArray&>(*codes);
+                    for (int64_t r = 0; r < rows; ++r) {
+                        batch.assets[r] = asset_of(a.GetView(r));
+                    }
+                    break;
+                }
+                case arrow::Type::LARGE_STRING: {
+                    const auto& a = static_cast<const arrow::LargeStringArray&>(*codes);
+                    for (int64_t r = 0; r < rows; ++r) {
+                        batch.assets[r] = asset_of(a.GetView(r));
+                    }
+                    break;
+                }
+                case arrow::Type::DICTIONARY: {
+                    const auto& a = static_cast<const arrow::DictionaryArray&>(*codes);
+                    if (a.dictionary()->type_id() != arrow::Type::STRING) {
+                        throw std::invalid_argument("Code column of " + file_name_ + " is not strings.");
+                    }
+                    const auto& dict = static_cast<const arrow::StringArray&>(*a.dictionary());
+                    std::vector<int> dict_assets(dict.length());
+                    for (int64_t k = 0; k < dict.length(); ++k) {
+                        dict_assets[k] = asset_of(dict.GetView(k));
+                    }
+                    for (int64_t r = 0; r < rows; ++r) {
+                        batch.assets[r] = dict_assets[a.GetValueIndex(r)];
+                    }
+                    break;
+                }
+                default:
+                    throw std::invalid_argument("Code column of " + file_name_ + " is " +
+                        codes->type()->ToString() + ", not strings.");
+                }
+            }
+
+            assets_ = static_cast<int>(codes_.size());
+            next_.resize(assets_);
+            next_.schema = std::move(schema);
+            next_.num_data_.resize(next_.schema->num_names.size(), assets_);
+            reset();
+            BasePriceDataImpl::init();
+        }
+
+        inline void ArrowDataImpl::reset() {
+            BasePriceDataImpl::reset();
+            bar_ = 0;
+            printed_.clear();
+            next_.reset();
+            next_.volume.setZero();
+        }
+
+        inline void ArrowDataImpl::seek(const ptime& time, int history) {
+            reset();
+            int64_t t = util::to_epoch_us(time);
+            auto it = std::partition_point(bars_.begin(), bars_.end(),
+                [&](const BarPos& bar) { return bar.time < t; });
+            bar_ = std::max(static_cast<int>(it - bars_.begin()) - history, 0);
+        }
+
+        inline bool ArrowDataImpl::read() {
+            if (bar_ >= static_cast<int>(bars_.size())) {
+                finished_ = true;
+                return false;
+            }
+            next_.time = util::from_epoch_us(bars_[bar_].time);
+            if (wide_) {
+                read_wide_();
+            }
+            else {
+                read_long_();
+            }
+            ++bar_;
+            apply_adj_factors_();
+            return true;
+        }
+
+        inline void ArrowDataImpl::read_wide_() {
+            const auto& pos = bars_[bar_];
+            const auto& cols = batches_[pos.batch].cols;
+            for (int i = 0; i < assets_; ++i) {
+                double v = cols[i][pos.row];
+                next_.data.open.coeffRef(i) = std::isnan(v) ? 0 : v;
+            }
+            auto& d = next_.data;
+            d.high = d.low = d.close = d.open;
+            next_.adj_data.open = d.open;
+            next_.adj_data.high = next_.adj_data.low = next_.adj_data.close = d.open;
+            next_.volume.setConstant(std::numeric_limits<int>::max());
+            next_.validate_assets();
+        }
+
+        inline void ArrowDataImpl::read_long_() {
+            // Only assets printed in last bar need to be cleared.
+            for (int i : printed_) {
+                next_.reset_asset(i);
+                next_.volume.coeffRef(i) = 0;
+            }
+            printed_.clear();
+
+            BarPos end = bar_ + 1 < static_cast<int>(bars_.size()) ? bars_[bar_ + 1]
+                : BarPos{ 0, static_cast<int>(batches_.size()), 0 };
+            int extras = static_cast<int>(next_.num_data_.rows());
+            int batches = static_cast<int>(batches_.size());
+            for (int b = bars_[bar_].batch; b <= end.batch && b < batches; ++b) {
+                const auto& batch = batches_[b];
+                int64_t first = b == bars_[bar_].batch ? bars_[bar_].row : 0;
+                int64_t last = b == end.batch ? end.row : batch.batch->num_rows();
+                const auto& cols = batch.cols;
+                for (int64_t r = first; r < last; ++r) {
+                    int i = batch.assets[r];
+                    printed_.push_back(i);
+                    next_.data.open.coeffRef(i) = next_.adj_data.open.coeffRef(i) = cols[0][r];
+                    next_.data.high.coeffRef(i) = next_.adj_data.high.coeffRef(i) = cols[1][r];
+                    next_.data.low.coeffRef(i) = next_.adj_data.low.coeffRef(i) = cols[2][r];
+                    next_.data.close.coeffRef(i) = next_.adj_data.close.coeffRef(i) = cols[3][r];
+                    if (!cols[4].empty()) {
+                        double v = cols[4][r];
+                        next_.volume.coeffRef(i) = std::isnan(v) ? 0
+                            : static_cast<int>(std::min(v, double(std::numeric_limits<int>::max())));
+                    }
+                    for (int j = 0; j < extras; ++j) {
+                        next_.num_data_(j, i) = cols[5 + j][r];
+                    }
+                    next_.validate_asset(i);
+                }
+            }
+        }
+    } // namespace feeds
+} // namespace backtradercpp
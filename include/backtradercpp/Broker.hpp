@@ -163,6 +163,10 @@ namespace backtradercpp {
 
             void _write_position();
             bool disable_price_check_ = false;
+
+            // Price of order is traded in the bar. With ticks, ticks of the asset at the price or
+            // better must have a total size of at least the volume of order.
+            static bool tradable_(const Order& order, const PriceEvaluatorInput& info);
         };
 
         struct XRDSetting {
@@ -402,6 +406,9 @@ namespace backtradercpp {
             }
 
             void sync_feed_agg(const feeds::PriceFeedAggragator& feed_agg_);
+            // Brokers read current prices from their feeds. data overrides it, e.g. with bars read ahead
+            // in Cerebro. nullptr restores data of the feed.
+            void set_data_ptr(int broker, PriceFeedData* data);
 
             void push_state();
             void pop_state(bool pop_stack = true);
@@ -459,6 +466,23 @@ namespace backtradercpp {
             tax_(std::make_shared<GenericTax>(long_tax_rate, long_commission_rate)) {
         }
 
+        inline bool BaseBrokerImpl::tradable_(const Order& order, const PriceEvaluatorInput& info) {
+            if (info.ticks.empty()) {
+                return (order.price >= info.low) && (order.price <= info.high);
+            }
+            int64_t need = std::abs(int64_t(order.volume)), size = 0;
+            for (const auto& t : info.ticks) {
+                if (t.asset == info.asset &&
+                    (order.volume > 0 ? t.price <= order.price : t.price >= order.price)) {
+                    size += t.size;
+                    if (size >= need) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
         inline void BaseBrokerImpl::process(Order& order) {
             // First check time
             int asset = order.asset;
@@ -472,13 +496,14 @@ namespace backtradercpp {
                 if (current_->valid.coeff(asset)) {
                     PriceEvaluatorInput info{
                         current_->data.open.coeff(asset), current_->data.high.coeff(asset),
-                        current_->data.low.coeff(asset), current_->data.close.coeff(asset) };
+                        current_->data.low.coeff(asset), current_->data.close.coeff(asset), asset,
+                        current_->ticks };
                     // Calculate price.
                     if (order.price_eval) {
                         order.price = order.price_eval->price(info);
                     }
                     //  1.Price is between min and max.
-                    if (disable_price_check_ || (order.price >= info.low) && (order.price <= info.high)) {
+                    if (disable_price_check_ || tradable_(order, info)) {
                         order.value = order.volume * order.price;
                         double commission = commission_->cal_commission(order.price, order.volume);
                         double tax = tax_->cal_tax(order.price, order.volume);
@@ -619,19 +644,20 @@ namespace backtradercpp {
         }
 
         void XRDTable::read(const std::string& file, const std::vector<int>& columns) {
-            std::string row;
-            std::ifstream f(file);
+            feeds::CSVReader f(file);
 
-            std::getline(f, row);
-            while (std::getline(f, row)) {
-                if (row.size() > 0) {
-                    auto row_string = feeds::CSVRowParaser::parse_row(row);
+            f.read_row();
+            while (f.read_row()) {
+                const auto& row_string = f.row();
+                if (!row_string.empty()) {
                     if (!row_string[columns[1]].empty()) {
-                        record_date.emplace_back(util::delimited_to_date(row_string[columns[0]]));
-                        execute_date.emplace_back(util::delimited_to_date(row_string[columns[1]]));
-                        setting.emplace_back(std::stod(row_string[columns[2]]),
-                            std::stod(row_string[columns[3]]),
-                            std::stod(row_string[columns[4]]));
+                        record_date.emplace_back(
+                            util::delimited_to_date(std::string(row_string[columns[0]])));
+                        execute_date.emplace_back(
+                            util::delimited_to_date(std::string(row_string[columns[1]])));
+                        setting.emplace_back(std::stod(std::string(row_string[columns[2]])),
+                            std::stod(std::string(row_string[columns[3]])),
+                            std::stod(std::string(row_string[columns[4]])));
                     }
                 }
             }
@@ -785,6 +811,10 @@ namespace backtradercpp {
             }
         }
 
+        inline void BrokerAggragator::set_data_ptr(int broker, PriceFeedData* data) {
+            brokers_[broker].set_data_ptr(data != nullptr ? data : brokers_[broker].feed().data_ptr());
+        }
+
         void BrokerAggragator::push_state()
         {
             std::vector<std::shared_ptr<BrokerState>> states;
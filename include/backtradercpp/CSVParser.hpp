@@ -0,0 +1,354 @@
+#pragma once
+
+#include "Compression.hpp"
+#include "MemoryUtil.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace backtradercpp {
+    namespace feeds {
+        // Fields of one csv line. Fields are separated by ',', a quote character (" or ') toggles
+        // quoting anywhere in a field and is removed, the same as boost::escaped_list_separator with
+        // no escape character. Fields are views into the line, only a field that has quote characters
+        // in middle is copied into internal storage. Views are valid until next parse().
+        // If columns are selected, only these fields are kept and other fields are skipped.
+        class CSVRow {
+        public:
+            void parse(std::string_view line);
+
+            // cols must be ascending. Empty for all columns.
+            void select(std::vector<int> cols) { selected_ = std::move(cols); }
+            // Column in line of i-th field.
+            int column(std::size_t i) const {
+                return selected_.empty() ? static_cast<int>(i) : selected_[i];
+            }
+
+            std::size_t size() const { return fields_.size(); }
+            bool empty() const { return fields_.empty(); }
+            std::string_view operator[](std::size_t i) const { return fields_[i]; }
+            const std::vector<std::string_view>& fields() const { return fields_; }
+
+        private:
+            static bool is_quote_(char c) { return c == '"' || c == '\''; }
+            std::string_view unquote_(std::string_view field);
+
+            std::vector<std::string_view> fields_;
+            std::vector<int> selected_;
+            std::deque<std::string> scratch_;
+            std::size_t scratch_used_ = 0;
+        };
+
+        enum class ParseStatus { Ok, Empty, Failed };
+
+        // Parse a number without allocation or exception. Surrounding whitespace and a leading '+' are
+        // allowed, "nan" and "inf" are accepted. value is NaN if status is not Ok.
+        ParseStatus parse_double(std::string_view s, double& value);
+
+        // Read a csv file line by line. The whole file is memory mapped, so reading a row doesn't
+        // allocate once field buffer has grown to the width of the file. Alternatively the file can be
+        // read by blocks of lines through a FilePool, so it is only opened while a block is loaded.
+        // A .gz or .zst file is decompressed by blocks as it is read, see util::CompressedStream.
+        // Offsets are then offsets in decompressed data, and seeking backwards decompresses again.
+        class CSVReader {
+        public:
+            static constexpr std::size_t compressed_block_size = 1 << 16;
+
+            CSVReader() = default;
+            explicit CSVReader(const std::string& file) { open(file); }
+
+            void open(const std::string& file) {
+                if (is_compressed_(file)) {
+                    open_stream_(file, compressed_block_size);
+                    return;
+                }
+                close();
+                file_.open(file);
+                file_name_ = file;
+                size_ = file_.size();
+                rewind();
+            }
+            // Read by blocks of about block_size bytes. A block grows if a line is longer.
+            void open(const std::string& file, util::FilePool& pool, std::size_t block_size) {
+                if (is_compressed_(file)) {
+                    // Compressed file is mapped, so it doesn't take a file of the pool and isn't limited by it.
+                    open_stream_(file, block_size);
+                    return;
+                }
+                close();
+                file_name_ = file;
+                size_ = std::filesystem::file_size(file);
+                pool_ = &pool;
+                block_size_ = block_size > 0 ? block_size : 1;
+                rewind();
+            }
+            void close() {
+                file_.close();
+                pool_ = nullptr;
+                stream_ = nullptr;
+                block_.clear();
+                block_begin_ = size_ = 0;
+            }
+            bool is_open() const { return file_.is_open() || pool_ != nullptr || stream_ != nullptr; }
+
+            // Parse next line into row(). Return false if end of file is reached. A trailing '\r' is
+            // removed and an empty line gives a row without fields.
+            bool read_row();
+            const CSVRow& row() const { return row_; }
+            // Only parse these columns of following rows, see CSVRow::select().
+            void select_columns(std::vector<int> cols) { row_.select(std::move(cols)); }
+            int column(std::size_t field) const { return row_.column(field); }
+            std::string_view line() const { return line_; }
+            // 1-based number of current line, header is line 1.
+            std::size_t line_number() const { return line_number_; }
+            const std::string& file() const { return file_name_; }
+
+            bool eof() const { return pos_ >= size_; }
+            // Byte offset of next line.
+            std::size_t offset() const { return pos_; }
+            // line_number is number of the line before offset.
+            void seek(std::size_t offset, std::size_t line_number) {
+                pos_ = offset;
+                line_number_ = line_number;
+            }
+            void rewind() { seek(0, 0); }
+
+        private:
+            static bool is_compressed_(const std::string& file) {
+                return util::CompressedStream::codec_of(file) != util::CompressedStream::Codec::None;
+            }
+            void open_stream_(const std::string& file, std::size_t block_size) {
+                close();
+                file_name_ = file;
+                stream_ = std::make_unique<util::CompressedStream>(file, block_size);
+                size_ = std::numeric_limits<std::size_t>::max(); // Known at end of stream.
+                rewind();
+            }
+            // Load a block that starts at pos_ and contains a whole line.
+            void load_block_();
+            // Decompress until block_ contains a whole line from pos_, or stream ends.
+            void load_stream_();
+
+            util::MappedFile file_;
+            std::string file_name_;
+            std::size_t size_ = 0, pos_ = 0, line_number_ = 0;
+            std::string_view line_;
+            CSVRow row_;
+
+            util::FilePool* pool_ = nullptr;
+            std::size_t block_size_ = 0;
+            std::string block_;
+            std::size_t block_begin_ = 0; // File offset of block_.
+
+            std::unique_ptr<util::CompressedStream> stream_ = nullptr;
+        };
+
+        // Number of cells that are empty or can't be parsed. Positions of at most max_positions failed
+        // cells are kept. record() may be called by parallel readers: counts are atomic, only keeping
+        // a position is locked, and kept positions are then not necessarily the first ones.
+        struct ParseErrors {
+            struct Position {
+                std::string file;
+                std::size_t line;
+                int col;
+                std::string text;
+            };
+            static constexpr std::size_t max_positions = 10;
+
+            std::size_t empty = 0, failed = 0;
+            std::vector<Position> positions;
+
+            void record(ParseStatus status, const CSVReader& reader, int col);
+            void clear() { *this = ParseErrors(); }
+        };
+
+        inline ParseStatus parse_double(std::string_view s, double& value) {
+            value = std::numeric_limits<double>::quiet_NaN();
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) {
+                s.remove_prefix(1);
+            }
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+                s.remove_suffix(1);
+            }
+            if (s.empty()) {
+                return ParseStatus::Empty;
+            }
+            if (s.front() == '+') {
+                s.remove_prefix(1);
+            }
+            double res;
+            auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), res);
+            if (ec != std::errc() || ptr != s.data() + s.size()) {
+                return ParseStatus::Failed;
+            }
+            value = res;
+            return ParseStatus::Ok;
+        }
+
+        inline void ParseErrors::record(ParseStatus status, const CSVReader& reader, int col) {
+            if (status == ParseStatus::Empty) {
+                std::atomic_ref(empty).fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (status == ParseStatus::Failed &&
+                std::atomic_ref(failed).fetch_add(1, std::memory_order_relaxed) < max_positions) {
+                Position pos{ reader.file(), reader.line_number(), reader.column(col),
+                    std::string(reader.row()[col]) };
+#pragma omp critical(bk_parse_errors)
+                positions.push_back(std::move(pos));
+            }
+        }
+
+        inline void CSVRow::parse(std::string_view line) {
+            fields_.clear();
+            scratch_used_ = 0;
+            if (line.empty()) {
+                return;
+            }
+            std::size_t i = 0, n = line.size();
+            std::size_t col = 0, next = 0; // next is index of next selected column.
+            while (true) {
+                std::size_t start = i;
+                bool quoted = false, in_quote = false;
+                for (; i < n; ++i) {
+                    char c = line[i];
+                    if (is_quote_(c)) {
+                        in_quote = !in_quote;
+                        quoted = true;
+                    }
+                    else if (c == ',' && !in_quote) {
+                        break;
+                    }
+                }
+                if (selected_.empty() || col == static_cast<std::size_t>(selected_[next])) {
+                    auto field = line.substr(start, i - start);
+                    fields_.push_back(quoted ? unquote_(field) : field);
+                    if (!selected_.empty() && ++next == selected_.size()) {
+                        break; // Rest of line is not needed.
+                    }
+                }
+                if (i == n) {
+                    break;
+                }
+                ++i; // Skip separator, a trailing separator gives an empty field.
+                ++col;
+            }
+        }
+
+        inline std::string_view CSVRow::unquote_(std::string_view field) {
+            // Common case: the whole field is quoted.
+            if (field.size() >= 2 && is_quote_(field.front()) && is_quote_(field.back())) {
+                auto inner = field.substr(1, field.size() - 2);
+                if (std::find_if(inner.begin(), inner.end(), is_quote_) == inner.end()) {
+                    return inner;
+                }
+            }
+            if (scratch_used_ == scratch_.size()) {
+                scratch_.emplace_back();
+            }
+            auto& s = scratch_[scratch_used_++];
+            s.clear();
+            for (char c : field) {
+                if (!is_quote_(c)) {
+                    s.push_back(c);
+                }
+            }
+            return s;
+        }
+
+        inline bool CSVReader::read_row() {
+            const char* begin = nullptr;
+            std::size_t avail = 0;
+            if (pos_ < size_) {
+                if (stream_ != nullptr) {
+                    load_stream_();
+                    std::size_t end = block_begin_ + block_.size();
+                    if (pos_ < end) {
+                        begin = block_.data() + (pos_ - block_begin_);
+                        avail = end - pos_;
+                    }
+                }
+                else if (pool_ == nullptr) {
+                    begin = file_.data() + pos_;
+                    avail = size_ - pos_;
+                }
+                else {
+                    // Reload if the block doesn't contain a whole line from pos_.
+                    std::size_t end = block_begin_ + block_.size();
+                    bool whole = pos_ >= block_begin_ && pos_ < end &&
+                        (end == size_ ||
+                            std::memchr(block_.data() + (pos_ - block_begin_), '\n', end - pos_));
+                    if (!whole) {
+                        load_block_();
+                    }
+                    begin = block_.data() + (pos_ - block_begin_);
+                    avail = block_begin_ + block_.size() - pos_;
+                }
+            }
+            if (avail == 0) {
+                line_ = {};
+                row_.parse(line_);
+                return false;
+            }
+            const char* nl = static_cast<const char*>(std::memchr(begin, '\n', avail));
+            std::size_t len = nl != nullptr ? nl - begin : avail;
+            pos_ += nl != nullptr ? len + 1 : len;
+            if (len > 0 && begin[len - 1] == '\r') {
+                --len;
+            }
+            line_ = std::string_view(begin, len);
+            ++line_number_;
+            row_.parse(line_);
+            return true;
+        }
+
+        inline void CSVReader::load_block_() {
+            std::size_t n = block_size_;
+            while (true) {
+                n = std::min(n, size_ - pos_);
+                block_.resize(n);
+                n = pool_->read(file_name_, pos_, block_.data(), n);
+                block_.resize(n);
+                block_begin_ = pos_;
+                if (n == 0) {
+                    size_ = pos_; // File is truncated.
+                    return;
+                }
+                if (pos_ + n >= size_ || std::memchr(block_.data(), '\n', n) != nullptr) {
+                    return;
+                }
+                n *= 2;
+            }
+        }
+
+        inline void CSVReader::load_stream_() {
+            if (pos_ < block_begin_) {
+                stream_->rewind();
+                block_.clear();
+                block_begin_ = 0;
+                size_ = std::numeric_limits<std::size_t>::max();
+            }
+            while (true) {
+                std::size_t end = block_begin_ + block_.size();
+                if (pos_ < end && std::memchr(block_.data() + (pos_ - block_begin_), '\n', end - pos_)) {
+                    return;
+                }
+                // Drop lines before pos_, only a partial line is kept.
+                std::size_t drop = std::min(pos_, end) - block_begin_;
+                block_.erase(0, drop);
+                block_begin_ += drop;
+                if (!stream_->read(block_)) {
+                    size_ = block_begin_ + block_.size();
+                    return;
+                }
+            }
+        }
+    } // namespace feeds
+} // namespace backtradercpp
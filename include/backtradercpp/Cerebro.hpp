@@ -4,11 +4,16 @@
 #include "DataFeeds.hpp"
 #include "Broker.hpp"
 #include "Strategy.hpp"
+#include "SPSCRing.hpp"
 #include "../../include/backtradercpp/RandomProcessGenerator.hpp"
 #include "../../include/backtradercpp/RandomProcessDataFeeds.hpp"
 
 #define SPDLOG_FMT_EXTERNAL
 #include <spdlog/stopwatch.h>
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <tuple>
 
 // #include<chrono>
 namespace backtradercpp {
@@ -23,10 +28,14 @@ namespace backtradercpp {
         // void init_feeds_aggrator_();
         void add_strategy(std::shared_ptr<strategy::GenericStrategy> strategy);
         void init_strategy();
+        // CSV feeds seek to start with a time index saved next to each file, see feeds::TimeIndex.
         void set_range(const date& start, const date& end = date(boost::date_time::max_date_time));
         // Set a directory for logging.
         void set_log_dir(const std::string& dir);
         void set_verbose(VerboseLevel v) { verbose_ = v; };
+        // Read up to `bars` bars ahead in a separate thread, so parsing overlaps with strategy and
+        // brokers. 0 (default) reads synchronously. Results are the same.
+        void set_prefetch(int bars) { prefetch_ = bars; }
 
         void run();
         void reset();
@@ -56,6 +65,14 @@ namespace backtradercpp {
         ptime start_{ boost::posix_time::min_date_time }, end_{ boost::posix_time::max_date_time };
 
         VerboseLevel verbose_ = VerboseLevel::AllInfo;
+        int prefetch_ = 0;
+
+        // Skip bars before start_ except those needed to fill windows.
+        void seek_start_();
+        void run_prefetched_();
+        // Run strategy and brokers on current bar.
+        void process_bar_(const spdlog::stopwatch& sw);
+        void report_parse_errors_() const;
     };
 
     void Cerebro::add_broker(broker::BaseBroker broker, int window) {
@@ -85,40 +102,157 @@ namespace backtradercpp {
         if (verbose_ == VerboseLevel::AllInfo)
             fmt::print(fmt::fg(fmt::color::yellow), "Runnng strategy..\n");
         init_strategy();
+        seek_start_();
 
-        while (!price_feeds_agg_.finished()) {
-            spdlog::stopwatch sw;
-
-            if ((!price_feeds_agg_.read()) || (price_feeds_agg_.time() > end_))
-                break;
-            common_feeds_agg_.read();
-            if (price_feeds_agg_.time() >= start_) {
-                if (verbose_ == VerboseLevel::AllInfo)
-                    fmt::print(fmt::runtime("┌{0:─^{2}}┐\n"
-                        "│{1: ^{2}}│\n"
-                        "└{0:─^{2}}┘\n"),
-                        "", util::to_string(price_feeds_agg_.time()), 21);
-
-                // fmt::print("{}\n", util::to_string(feeds_agg_.time()));
-                broker_agg_.process_old_orders();
-                auto order_pool = strategy_->execute();
-                broker_agg_.process(order_pool);
-                broker_agg_.process_terms();
-                broker_agg_.update_info();
-
-                if (verbose_ == VerboseLevel::AllInfo) {
-                    fmt::print("cash: {:12.4f},  total_wealth: {:12.2f}\n", broker_agg_.total_cash(),
-                        broker_agg_.total_wealth());
-                    fmt::print("Using {} seconds.\n", util::sw_to_seconds(sw));
-                }
+        if (prefetch_ > 0) {
+            run_prefetched_();
+        }
+        else {
+            while (!price_feeds_agg_.finished()) {
+                spdlog::stopwatch sw;
+
+                if ((!price_feeds_agg_.read()) || (price_feeds_agg_.time() > end_))
+                    break;
+                common_feeds_agg_.read();
+                process_bar_(sw);
             }
         }
-        if (verbose_ == VerboseLevel::OnlySummary || verbose_ == VerboseLevel::AllInfo)
+        if (verbose_ == VerboseLevel::OnlySummary || verbose_ == VerboseLevel::AllInfo) {
             broker_agg_.summary();
+            report_parse_errors_();
+        }
         strategy_->finish_all();
         // strategy_-
     }
 
+    inline void Cerebro::process_bar_(const spdlog::stopwatch& sw) {
+        if (price_feeds_agg_.time() < start_) {
+            return;
+        }
+        if (verbose_ == VerboseLevel::AllInfo)
+            fmt::print(fmt::runtime("┌{0:─^{2}}┐\n"
+                "│{1: ^{2}}│\n"
+                "└{0:─^{2}}┘\n"),
+                "", util::to_string(price_feeds_agg_.time()), 21);
+
+        // fmt::print("{}\n", util::to_string(feeds_agg_.time()));
+        broker_agg_.process_old_orders();
+        auto order_pool = strategy_->execute();
+        broker_agg_.process(order_pool);
+        broker_agg_.process_terms();
+        broker_agg_.update_info();
+
+        if (verbose_ == VerboseLevel::AllInfo) {
+            fmt::print("cash: {:12.4f},  total_wealth: {:12.2f}\n", broker_agg_.total_cash(),
+                broker_agg_.total_wealth());
+            fmt::print("Using {} seconds.\n", util::sw_to_seconds(sw));
+        }
+    }
+
+    inline void Cerebro::seek_start_() {
+        if (price_feeds_agg_.time() >= start_ || common_feeds_agg_.time() >= start_) {
+            return; // Feeds are already read, or no start is set.
+        }
+        // Common data is read along with prices, so both replay the same number of bars.
+        int history = std::max(price_feeds_agg_.max_window(), common_feeds_agg_.max_window());
+        price_feeds_agg_.seek(start_, history);
+        common_feeds_agg_.seek(start_, history);
+    }
+
+    // Producer thread fetches bars from feeds into a ring, and this thread commits them into buffers.
+    // Brokers read prices from feeds directly, so they are pointed to the bar being processed.
+    inline void Cerebro::run_prefetched_() {
+        struct Slot {
+            feeds::PriceFeedAggragator::Bar price;
+            feeds::CommonFeedAggragator::Bar common;
+            bool last = false;
+        };
+        // One more slot for the bar being processed.
+        util::SPSCRing<Slot> ring(prefetch_ + 1);
+        std::exception_ptr error = nullptr;
+
+        std::thread producer([&] {
+            Slot* slot = nullptr;
+            try {
+                while ((slot = ring.acquire()) != nullptr) {
+                    slot->last = !price_feeds_agg_.fetch(slot->price) || (slot->price.time > end_);
+                    if (!slot->last) {
+                        common_feeds_agg_.fetch(slot->common);
+                    }
+                    ring.push();
+                    if (slot->last) {
+                        break;
+                    }
+                }
+            }
+            catch (...) {
+                error = std::current_exception();
+                slot->price.ok = false;
+                slot->last = true;
+                ring.push();
+            }
+        });
+
+        try {
+            Slot* slot = nullptr;
+            while (true) {
+                spdlog::stopwatch sw;
+                if (slot != nullptr) {
+                    ring.pop(); // Release last bar.
+                }
+                slot = ring.front();
+                price_feeds_agg_.commit(slot->price);
+                if (slot->last) {
+                    break;
+                }
+                common_feeds_agg_.commit(slot->common);
+                for (std::size_t i = 0; i < slot->price.data.size(); ++i) {
+                    broker_agg_.set_data_ptr(i, &slot->price.data[i]);
+                }
+                process_bar_(sw);
+            }
+        }
+        catch (...) {
+            ring.close();
+            producer.join();
+            for (std::size_t i = 0; i < price_feeds_agg_.feeds().size(); ++i) {
+                broker_agg_.set_data_ptr(i, nullptr);
+            }
+            throw;
+        }
+        producer.join();
+        for (std::size_t i = 0; i < price_feeds_agg_.feeds().size(); ++i) {
+            broker_agg_.set_data_ptr(i, nullptr);
+        }
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    inline void Cerebro::report_parse_errors_() const {
+        auto report = [](const auto& feeds) {
+            for (std::size_t i = 0; i < feeds.size(); ++i) {
+                const auto& errors = feeds[i].parse_errors();
+                if (errors.failed == 0) {
+                    continue;
+                }
+                // Positions are kept in the order parallel readers reach them, so report the
+                // earliest kept one, which needn't be the first failed cell of the data.
+                const auto& pos = *std::min_element(errors.positions.begin(), errors.positions.end(),
+                    [](const auto& a, const auto& b) {
+                        return std::tie(a.file, a.line, a.col) < std::tie(b.file, b.line, b.col);
+                    });
+                fmt::print(fmt::fg(fmt::color::yellow),
+                    "Data feed {} {}: {} cells are not numbers, {} cells are empty, e.g. \"{}\" "
+                    "in {} line {} column {}.\n",
+                    i, feeds[i].name(), errors.failed, errors.empty, pos.text, pos.file, pos.line,
+                    pos.col);
+            }
+        };
+        report(price_feeds_agg_.feeds());
+        report(common_feeds_agg_.feeds());
+    }
+
     void Cerebro::reset() {
         price_feeds_agg_.reset();
         common_feeds_agg_.reset();
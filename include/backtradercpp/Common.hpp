@@ -11,11 +11,19 @@
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <fmt/color.h>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <numeric>
+#include <span>
+#include <string_view>
 #include <unordered_map>
 #include <fort.hpp>
 
+#include "MemoryUtil.hpp"
 #include "util.hpp"
 
 namespace backtradercpp {
@@ -23,6 +31,7 @@ namespace backtradercpp {
     using VecArrXi = Eigen::Array<int, Eigen::Dynamic, 1>;
     using VecArrXb = Eigen::Array<bool, Eigen::Dynamic, 1>;
     using RowArrayXd = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+    using RowArrayXi = Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
 
     using boost::gregorian::date;
     using boost::gregorian::date_duration;
@@ -40,6 +49,106 @@ namespace backtradercpp {
         VecArrXd open, high, low, close, ret, adj_ret;
         void resize(int assets);
         void reset();
+        void reset_asset(int asset);
+    };
+    // Interned values of a string column. Code 0 is the empty string. A feed may add values while
+    // strategy reads values of codes it has got, e.g. with Cerebro::set_prefetch: values never move,
+    // and only adding and find() are locked.
+    class StringDict {
+    public:
+        StringDict() { code(""); }
+        StringDict(const StringDict&) = delete;
+        StringDict& operator=(const StringDict&) = delete;
+
+        // Code of s, added if new.
+        int code(std::string_view s);
+        // Code of s, -1 if not found.
+        int find(std::string_view s) const;
+        const std::string& value(int code) const {
+            auto [chunk, pos] = locate_(code);
+            return chunks_[chunk][pos];
+        }
+        int size() const { return size_.load(std::memory_order_acquire); }
+
+    private:
+        // Chunk k has 2^(k + first_bits_) values, so chunks never move.
+        static constexpr int first_bits_ = 6;
+        static std::pair<int, int> locate_(int code) {
+            unsigned c = static_cast<unsigned>(code) + (1u << first_bits_);
+            int chunk = std::bit_width(c) - 1 - first_bits_;
+            return { chunk, static_cast<int>(c - (1u << (chunk + first_bits_))) };
+        }
+        struct Hash {
+            using is_transparent = void;
+            std::size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+        };
+
+        std::array<std::unique_ptr<std::string[]>, 32 - first_bits_> chunks_;
+        std::atomic<int> size_{ 0 };
+        mutable std::mutex mutex_;
+        std::unordered_map<std::string, int, Hash, std::equal_to<>> index_;
+    };
+
+    // A string column of a bar, i.e. codes of assets and the dictionary of the column.
+    class StrColumn {
+    public:
+        StrColumn(const int* codes, int assets, const StringDict* dict)
+            : codes_(codes), assets_(assets), dict_(dict) {}
+
+        int size() const { return assets_; }
+        const std::string& operator[](int asset) const { return dict_->value(codes_[asset]); }
+        Eigen::Map<const VecArrXi> codes() const { return Eigen::Map<const VecArrXi>(codes_, assets_); }
+        const StringDict& dict() const { return *dict_; }
+
+        // Assets whose value is s.
+        VecArrXb eq(std::string_view s) const;
+        // Code and assets of each value in the bar, in order of the first asset of each value.
+        std::vector<std::pair<int, std::vector<int>>> groups() const;
+
+    private:
+        const int* codes_;
+        int assets_;
+        const StringDict* dict_;
+    };
+
+    // Position of a column in feed data, see FieldSchema::field().
+    struct FieldHandle {
+        int index = -1;
+        bool is_str = false;
+
+        // Return the handle if it is a column of that kind, throw std::out_of_range if not.
+        FieldHandle num() const { return expect_(false); }
+        FieldHandle str() const { return expect_(true); }
+
+    private:
+        FieldHandle expect_(bool str) const;
+    };
+    // Names of numeric and string columns of a feed, resolved once when the feed is set up. Values
+    // are stored by index in feed data.
+    struct FieldSchema {
+        std::vector<std::string> num_names, str_names;
+        std::unordered_map<std::string, int> num_index, str_index;
+        // Dictionaries of string columns of price data.
+        std::vector<std::shared_ptr<StringDict>> str_dicts;
+
+        void add_num(const std::string& name) {
+            num_index[name] = num_names.size();
+            num_names.push_back(name);
+        }
+        void add_str(const std::string& name) {
+            str_index[name] = str_names.size();
+            str_names.push_back(name);
+            str_dicts.push_back(std::make_shared<StringDict>());
+        }
+        // Throw std::out_of_range if there is no such column.
+        FieldHandle field(const std::string& name) const;
+    };
+    // A trade, as stored in tick files, see feeds::TickFile.
+    struct Tick {
+        int64_t time; // Microseconds since epoch.
+        int32_t asset;
+        int32_t size;
+        double price;
     };
     struct PriceFeedData {
         PriceFeedData() {}
@@ -50,19 +159,32 @@ namespace backtradercpp {
         VecArrXi volume;
         VecArrXb valid;
 
-        std::unordered_map<std::string, VecArrXd> num_data_;
-        std::unordered_map<std::string, std::vector<std::string>> str_data_;
+        // Extra columns, see schema. Both are fields x assets, str_data_ has codes of dictionaries in
+        // schema.
+        std::shared_ptr<const FieldSchema> schema = nullptr;
+        RowArrayXd num_data_;
+        RowArrayXi str_data_;
+
+        // Ticks of the bar in time order, only set by tick feeds with intra-bar ticks on. ticks_owner
+        // keeps them alive.
+        std::span<const Tick> ticks;
+        std::shared_ptr<const void> ticks_owner = nullptr;
 
         void validate_assets();
+        void validate_asset(int asset);
         void resize(int assets);
 
         void reset();
+        void reset_asset(int asset);
 
     };
     struct CommonFeedData {
         boost::posix_time::ptime time;
-        std::unordered_map<std::string, double> num_data_;
-        std::unordered_map<std::string, std::string> str_data_;
+        bool valid = true; // False for a bar pushed when feed has no data.
+        std::shared_ptr<const FieldSchema> schema = nullptr;
+        // Values in order of schema columns.
+        std::vector<double> num_data_;
+        std::vector<std::string> str_data_;
     };
     template <typename T> class FeedDataBuffer {
     public:
@@ -80,143 +202,265 @@ namespace backtradercpp {
         virtual void push_back(const T& new_data) { data_.push_back(new_data); }
         virtual void push_back_() = 0;
 
-        const auto& num(int k, const std::string& name) const;
-        const auto& num(const std::string& name) const;
-        const auto& num() const;
-        const auto& str(int k, const std::string& name) const;
-        const auto& str(const std::string& name) const;
-        const auto& str() const;
-
     protected:
         int window_ = 1;
         boost::circular_buffer<T> data_;
         bool valid_ = false;
     };
 
-    class PriceFeedDataBuffer : public FeedDataBuffer<PriceFeedData> {
+    // Bars of a price feed in a window. Each field is a ring of window x assets with a moving head,
+    // so pushing a bar copies one row per field without allocating, and the history of an asset is
+    // a column. Rings of prices are mirrored, see util::MirroredBuffer, so a window is always one
+    // block, with rows padded to whole pages.
+    class PriceFeedDataBuffer {
     public:
-        PriceFeedDataBuffer() = default;
+        // Last window of an asset, and of all assets with a row per bar. Like cross sections, they
+        // are views valid until next bar is pushed.
+        using Column = Eigen::Map<const VecArrXd, 0, Eigen::InnerStride<>>;
+        using Window = Eigen::Map<const RowArrayXd, 0, Eigen::OuterStride<>>;
+
+        PriceFeedDataBuffer() : PriceFeedDataBuffer(0) {}
         PriceFeedDataBuffer(int assets, int window = 1);
+        // Assets and columns of data, which may not be read yet, with an empty bar.
         PriceFeedDataBuffer(const PriceFeedData& data, int window = 1);
 
-        VecArrXd open(int time = -1) const; // negative indices, -1 for latest
+        // Cross sections are views of a bar, valid until next bar is pushed. Time is a negative index,
+        // -1 for latest.
+        Eigen::Map<const VecArrXd> open(int time = -1) const;
         double open(int time, int stock) const;
-        VecArrXd open(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret open(Sel r, Sel c) const;
+        Column open(Sel s, int stock) const;
+        template <typename Ret = Window> Ret open(Sel r, Sel c) const;
 
-        VecArrXd high(int time = -1) const;
+        Eigen::Map<const VecArrXd> high(int time = -1) const;
         double high(int time, int stock) const;
-        VecArrXd high(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret high(Sel r, Sel c) const;
+        Column high(Sel s, int stock) const;
+        template <typename Ret = Window> Ret high(Sel r, Sel c) const;
 
-        VecArrXd low(int time = -1) const;
+        Eigen::Map<const VecArrXd> low(int time = -1) const;
         double low(int time, int stock) const;
-        VecArrXd low(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret low(Sel r, Sel c) const;
+        Column low(Sel s, int stock) const;
+        template <typename Ret = Window> Ret low(Sel r, Sel c) const;
 
-        VecArrXd close(int time = -1) const;
+        Eigen::Map<const VecArrXd> close(int time = -1) const;
         double close(int time, int stock) const;
-        VecArrXd close(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret close(Sel r, Sel c) const;
+        Column close(Sel s, int stock) const;
+        template <typename Ret = Window> Ret close(Sel r, Sel c) const;
 
-        VecArrXd adj_open(int time = -1) const;
+        Eigen::Map<const VecArrXd> adj_open(int time = -1) const;
         double adj_open(int time, int stock) const;
-        VecArrXd adj_open(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret adj_open(Sel r, Sel c) const;
+        Column adj_open(Sel s, int stock) const;
+        template <typename Ret = Window> Ret adj_open(Sel r, Sel c) const;
 
-        VecArrXd adj_high(int time = -1) const;
+        Eigen::Map<const VecArrXd> adj_high(int time = -1) const;
         double adj_high(int time, int stock) const;
-        VecArrXd adj_high(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret adj_high(Sel r, Sel c) const;
+        Column adj_high(Sel s, int stock) const;
+        template <typename Ret = Window> Ret adj_high(Sel r, Sel c) const;
 
-        VecArrXd adj_low(int time = -1) const;
+        Eigen::Map<const VecArrXd> adj_low(int time = -1) const;
         double adj_low(int time, int stock) const;
-        VecArrXd adj_low(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret adj_low(Sel r, Sel c) const;
+        Column adj_low(Sel s, int stock) const;
+        template <typename Ret = Window> Ret adj_low(Sel r, Sel c) const;
 
-        VecArrXd adj_close(int time = -1) const;
+        Eigen::Map<const VecArrXd> adj_close(int time = -1) const;
         double adj_close(int time, int stock) const;
-        VecArrXd adj_close(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret adj_close(Sel r, Sel c) const;
+        Column adj_close(Sel s, int stock) const;
+        template <typename Ret = Window> Ret adj_close(Sel r, Sel c) const;
 
-        VecArrXi volume(int time = -1) const;
+        Eigen::Map<const VecArrXi> volume(int time = -1) const;
         int volume(int time, int stock) const;
-        VecArrXb valid(int time = -1) const;
+        Eigen::Map<const VecArrXb> valid(int time = -1) const;
         bool valid(int time, int stock) const;
 
-        VecArrXd ret(int time = -1) const;
+        Eigen::Map<const VecArrXd> ret(int time = -1) const;
         double ret(int time, int stock) const;
-        VecArrXd ret(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret ret(Sel r, Sel c) const;
+        Column ret(Sel s, int stock) const;
+        template <typename Ret = Window> Ret ret(Sel r, Sel c) const;
 
-        VecArrXd adj_ret(int time = -1) const;
+        Eigen::Map<const VecArrXd> adj_ret(int time = -1) const;
         double adj_ret(int time, int stock) const;
-        VecArrXd adj_ret(Sel s, int stock) const;
-        template <typename Ret = RowArrayXd> Ret adj_ret(Sel r, Sel c) const;
-
-        // template <typename T>
-        // requires requires { std::is_same_v<T, FeedData>; }
-        // calculate ret
-        void push_back(const PriceFeedData& new_data) override
-        {
-            data_.push_back(new_data);
-            if (data_.size() > 1)
-            {
-                auto& last_feed = data_[data_.size() - 2];
-                auto& feed = data_.back();
-                for (int i = 0; i < feed.data.close.size(); ++i)
-                {
-                    auto last_close = last_feed.data.close.coeff(i);
-                    if (last_close != 0)
-                    {
-                        feed.data.ret.coeffRef(i) = feed.data.close[i] / last_close - 1;
-                    }
-                    else
-                    {
-                        feed.data.ret.coeffRef(i) = 0;
-                    }
-                    auto last_adj_close = last_feed.adj_data.ret.coeff(i);
-                    if (last_adj_close != 0)
-                    {
-                        feed.adj_data.ret.coeffRef(i) = feed.adj_data.close[i] / last_adj_close - 1;
-                    }
-                    else
-                    {
-                        feed.adj_data.ret.coeffRef(i) = 0;
-                    }
-                }
-            }
-        }
-        void push_back_() override { data_.push_back(PriceFeedData(assets_)); }
+        Column adj_ret(Sel s, int stock) const;
+        template <typename Ret = Window> Ret adj_ret(Sel r, Sel c) const;
+
+        // Like ret, fields derived from a bar and the previous one when the bar is pushed. Gap is
+        // open over last close, minus 1. True range is high minus low, extended to last close.
+        // Without a last close they are 0, or high minus low.
+        Eigen::Map<const VecArrXd> log_ret(int time = -1) const;
+        double log_ret(int time, int stock) const;
+        Column log_ret(Sel s, int stock) const;
+        template <typename Ret = Window> Ret log_ret(Sel r, Sel c) const;
+
+        Eigen::Map<const VecArrXd> adj_log_ret(int time = -1) const;
+        double adj_log_ret(int time, int stock) const;
+        Column adj_log_ret(Sel s, int stock) const;
+        template <typename Ret = Window> Ret adj_log_ret(Sel r, Sel c) const;
+
+        Eigen::Map<const VecArrXd> gap(int time = -1) const;
+        double gap(int time, int stock) const;
+        Column gap(Sel s, int stock) const;
+        template <typename Ret = Window> Ret gap(Sel r, Sel c) const;
+
+        Eigen::Map<const VecArrXd> true_range(int time = -1) const;
+        double true_range(int time, int stock) const;
+        Column true_range(Sel s, int stock) const;
+        template <typename Ret = Window> Ret true_range(Sel r, Sel c) const;
+
+        int window() const { return window_; }
+        // Latest bars that fit are kept.
+        void set_window(int window);
+
+        // Overwrite the oldest bar, and derive fields from last bar.
+        void push_back(const PriceFeedData& new_data);
+        // Push an empty bar, for feeds without data at current time.
+        void push_back_();
 
         auto assets() const { return assets_; }
-        const auto& time() const { return data_.back().time; }
+        const auto& time() const { return times_[row_(-1)]; }
 
-        // const auto &num(int k, const std::string &name) const;
-        // const auto &num(const std::string &name) const;
-        // const auto &str(int k, const std::string &name) const;
-        // const auto &str(const std::string &name) const;
+        // Extra columns. Resolve a column once with field() and read it by the handle. Numeric
+        // columns are returned as views of the bar, valid until next bar is pushed.
+        const FieldSchema& schema() const { return *schema_; }
+        FieldHandle field(const std::string& name) const;
+
+        // Throw std::out_of_range if f is a column of the other kind.
+        Eigen::Map<const VecArrXd> num(int k, FieldHandle f) const {
+            return num_row_(row_(k), f.num());
+        }
+        StrColumn str(int k, FieldHandle f) const { return str_row_(row_(k), f.str()); }
+        Eigen::Map<const VecArrXd> num(int k, const std::string& name) const {
+            return num(k, field(name));
+        }
+        Eigen::Map<const VecArrXd> num(const std::string& name) const { return num(-1, name); }
+        StrColumn str(int k, const std::string& name) const { return str(k, field(name)); }
+        StrColumn str(const std::string& name) const { return str(-1, name); }
+        // All extra columns of last bar, fields x assets. String columns are codes.
+        Eigen::Map<const RowArrayXd> num() const {
+            return { num_.data() + row_(-1) * num_.cols(), fields_(num_), assets_ };
+        }
+        Eigen::Map<const RowArrayXi> str() const {
+            return { str_.data() + row_(-1) * str_.cols(), fields_(str_), assets_ };
+        }
 
     private:
+        using RowArrayXb = Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+        // Rings of prices_, adjusted ones follow raw ones in the same order, then fields of raw
+        // prices only.
+        enum PriceField {
+            Open, High, Low, Close, Ret, LogRet,
+            AdjOpen, AdjHigh, AdjLow, AdjClose, AdjRet, AdjLogRet,
+            Gap, TrueRange
+        };
+        static constexpr int price_fields_ = 14;
+        // A field derived into res from bar of row r and previous bar of row last. Adjusted fields
+        // share derive with raw ones, and read prices from adj, i.e. AdjOpen or 0.
+        struct DerivedField {
+            PriceField field;
+            int adj;
+            void (*derive)(const PriceFeedDataBuffer& b, int adj, int r, int last,
+                Eigen::Map<VecArrXd> res);
+        };
+        static std::span<const DerivedField> derived_fields_();
+
+        // Rows of rings and stride of rows of prices for a window, so that a ring of prices is
+        // whole pages to be mirrored.
+        static std::pair<int, int> ring_shape_(int window, int assets);
+        // Ring row of a bar, -1 for latest.
+        int row_(int time) const { return (next_ + rows_ + time) % rows_; }
+        const double* price_(int field) const {
+            return reinterpret_cast<const double*>(prices_[field].data());
+        }
+        double* price_row_(int field, int r) {
+            return reinterpret_cast<double*>(prices_[field].data()) + r * stride_;
+        }
+        Eigen::Map<const VecArrXd> bar_(int field, int r) const {
+            return { price_(field) + r * stride_, assets_ };
+        }
+        Eigen::Map<const VecArrXb> valid_row_(int r) const {
+            return { valid_.data() + r * assets_, assets_ };
+        }
+        Eigen::Map<RowArrayXd, 0, Eigen::OuterStride<>> price_ring_(int field) {
+            return { price_row_(field, 0), rows_, assets_, Eigen::OuterStride<>(stride_) };
+        }
+        // Row of the bar being pushed.
+        int advance_();
+        int fields_(const auto& ring) const { return assets_ > 0 ? ring.cols() / assets_ : 0; }
+        // Copy v into a row of size values, or zero it if v has another size.
+        template <typename T, typename Vec> static void set_row_(T* row, int size, const Vec& v);
+        // Copy latest bars to a ring of rows, with latest one in last row.
+        template <typename Ring, typename Res> void rewindow_(const Ring& ring, Res&& res) const;
+        template <typename Ring> Ring rewindow_(const Ring& ring, int rows) const;
+
+        Eigen::Map<const VecArrXd> num_row_(int r, FieldHandle f) const {
+            return Eigen::Map<const VecArrXd>(num_.data() + r * num_.cols() + f.index * assets_,
+                assets_);
+        }
+        StrColumn str_row_(int r, FieldHandle f) const {
+            return StrColumn(str_.data() + r * str_.cols() + f.index * assets_, assets_,
+                schema_->str_dicts[f.index].get());
+        }
+
+        int window_ = 1;
         int assets_ = 0;
+        int rows_ = 2;   // Rows of rings, at least window_ and last bar.
+        int stride_ = 0; // Of rows of prices_, at least assets_.
+        int next_ = 0; // Row of next bar, which is the oldest one when rings are full.
+
+        std::array<util::MirroredBuffer, price_fields_> prices_;
+        RowArrayXi volume_;
+        RowArrayXb valid_;
+        std::vector<ptime> times_;
+        // Extra columns, a row is fields x assets of a bar.
+        RowArrayXd num_;
+        RowArrayXi str_;
+        std::shared_ptr<const FieldSchema> schema_ = nullptr;
     };
 
     class CommonFeedDataBuffer : public FeedDataBuffer<CommonFeedData> {
     public:
         CommonFeedDataBuffer() = default;
         CommonFeedDataBuffer(int window) : FeedDataBuffer(window) {}
-        CommonFeedDataBuffer(const CommonFeedData& data, int window = 1) : FeedDataBuffer(window) {
-            data_.push_back(data);
+        // Columns of data, which may not be read yet, with an empty bar.
+        CommonFeedDataBuffer(const CommonFeedData& data, int window = 1)
+            : FeedDataBuffer(window), schema_(data.schema) {
+            push_back_();
         }
 
-        void push_back_() override {
-            std::cout << "Common data" << std::endl;
-            data_.push_back(CommonFeedData());
+        // Recycle the oldest slot when window is full, so values keep their capacity.
+        void push_back_() override;
+
+        const FieldSchema& schema() const { return *schema_; }
+        // Resolve a column once, e.g. in strategy constructor, and read it by the handle without
+        // looking up its name on every bar. Throw std::out_of_range if there is no such column.
+        FieldHandle field(const std::string& name) const;
+
+        // If k-th bar has data.
+        bool valid(int k = -1) const { return data_[window_ + k].valid; }
+        // Throw std::out_of_range if f is a column of the other kind.
+        double num(int k, FieldHandle f) const {
+            return data_[window_ + k].num_data_[f.num().index];
+        }
+        const std::string& str(int k, FieldHandle f) const {
+            return data_[window_ + k].str_data_[f.str().index];
+        }
+        double num(int k, const std::string& name) const { return num(k, field(name)); }
+        double num(const std::string& name) const {
+            return data_.back().num_data_[field(name).num().index];
         }
+        const std::string& str(int k, const std::string& name) const { return str(k, field(name)); }
+        const std::string& str(const std::string& name) const {
+            return data_.back().str_data_[field(name).str().index];
+        }
+        // Values of last bar, in order of schema().num_names and schema().str_names.
+        const auto& num() const { return data_.back().num_data_; }
+        const auto& str() const { return data_.back().str_data_; }
+
+    private:
+        std::shared_ptr<const FieldSchema> schema_ = nullptr;
     };
 
     struct PriceEvaluatorInput {
         double open, high, low, close;
+        int asset = -1;
+        std::span<const Tick> ticks; // Ticks of all assets in the bar, see PriceFeedData::ticks.
     };
     struct GenericPriceEvaluator {
         virtual double price(const PriceEvaluatorInput& input) = 0;
@@ -335,22 +579,6 @@ namespace backtradercpp {
         BK_DEFINE_PORTFOLIO_MEMBER_VEC_ACCESSOR(dyn_adj_profit, VecArrXd, 0)
 #undef BK_DEFINE_PORTFOLIO_MEMBER_VEC_ACCESSOR
 
-#define BK_DEFINE_FeedDataBuffer_EXTRA_ACCESSOS(name)                                              \
-    template <typename T>                                                                          \
-    const auto &FeedDataBuffer<T>::name(int k, const std::string &name_) const {                   \
-        return data_[window_ + k].name##_data_.at(name_);                                          \
-    }                                                                                              \
-    template <typename T> const auto &FeedDataBuffer<T>::name(const std::string &name_) const {    \
-        return data_.back().name##_data_.at(name_);                                                \
-    }                                                                                              \
-    template <typename T> const auto &FeedDataBuffer<T>::name() const {                            \
-        return data_.back().name##_data_;                                                          \
-    }
-
-        BK_DEFINE_FeedDataBuffer_EXTRA_ACCESSOS(num);
-    BK_DEFINE_FeedDataBuffer_EXTRA_ACCESSOS(str);
-#undef BK_DEFINE_FULLASSETDATA_EXTRA_ACCESSOS
-
     inline void Portfolio::update(const Order& order, double adj_price) {
         int asset = order.asset;
         auto it = portfolio_items.find(asset);
@@ -419,6 +647,102 @@ namespace backtradercpp {
             ele->setConstant(0);
         }
     }
+    inline void OHLCData::reset_asset(int asset) {
+        for (auto& ele : { &open, &high, &low, &close, &ret }) {
+            ele->coeffRef(asset) = 0;
+        }
+    }
+
+    inline int StringDict::code(std::string_view s) {
+        std::lock_guard lock(mutex_);
+        if (auto it = index_.find(s); it != index_.end()) {
+            return it->second;
+        }
+        int code = size_.load(std::memory_order_relaxed);
+        auto [chunk, pos] = locate_(code);
+        if (chunks_[chunk] == nullptr) {
+            chunks_[chunk] = std::make_unique<std::string[]>(std::size_t(1) << (chunk + first_bits_));
+        }
+        chunks_[chunk][pos] = s;
+        index_.emplace(std::string(s), code);
+        size_.store(code + 1, std::memory_order_release);
+        return code;
+    }
+    inline int StringDict::find(std::string_view s) const {
+        std::lock_guard lock(mutex_);
+        auto it = index_.find(s);
+        return it != index_.end() ? it->second : -1;
+    }
+
+    inline VecArrXb StrColumn::eq(std::string_view s) const {
+        int code = dict_->find(s);
+        if (code < 0) {
+            return VecArrXb::Constant(assets_, false);
+        }
+        return codes() == code;
+    }
+    inline std::vector<std::pair<int, std::vector<int>>> StrColumn::groups() const {
+        std::vector<std::pair<int, std::vector<int>>> res;
+        std::unordered_map<int, std::size_t> group_of;
+        for (int i = 0; i < assets_; ++i) {
+            auto [it, added] = group_of.try_emplace(codes_[i], res.size());
+            if (added) {
+                res.emplace_back(codes_[i], std::vector<int>());
+            }
+            res[it->second].second.push_back(i);
+        }
+        return res;
+    }
+
+    inline FieldHandle FieldSchema::field(const std::string& name) const {
+        if (auto it = num_index.find(name); it != num_index.end()) {
+            return { it->second, false };
+        }
+        if (auto it = str_index.find(name); it != str_index.end()) {
+            return { it->second, true };
+        }
+        throw std::out_of_range("No column " + name + " in data.");
+    }
+    inline FieldHandle FieldHandle::expect_(bool str) const {
+        if (index < 0 || is_str != str) {
+            throw std::out_of_range(fmt::format("Column {} is not a {} column.", index,
+                str ? "string" : "numeric"));
+        }
+        return *this;
+    }
+    inline void CommonFeedDataBuffer::push_back_() {
+        if (data_.full()) {
+            data_.rotate(data_.begin() + 1);
+        }
+        else {
+            data_.push_back(CommonFeedData());
+        }
+        auto& empty = data_.back();
+        empty.time = boost::posix_time::ptime();
+        empty.valid = false;
+        empty.schema = schema_;
+        if (schema_ != nullptr) {
+            empty.num_data_.assign(schema_->num_names.size(),
+                std::numeric_limits<double>::quiet_NaN());
+            empty.str_data_.assign(schema_->str_names.size(), std::string());
+        }
+        else {
+            empty.num_data_.clear();
+            empty.str_data_.clear();
+        }
+    }
+    inline FieldHandle CommonFeedDataBuffer::field(const std::string& name) const {
+        if (schema_ == nullptr) {
+            throw std::out_of_range("No column " + name + " in data.");
+        }
+        return schema_->field(name);
+    }
+    inline FieldHandle PriceFeedDataBuffer::field(const std::string& name) const {
+        if (schema_ == nullptr) {
+            throw std::out_of_range("No column " + name + " in data.");
+        }
+        return schema_->field(name);
+    }
 
     inline PriceFeedData::PriceFeedData(int assets) { valid = VecArrXb::Constant(assets, false); }
 
@@ -427,67 +751,247 @@ namespace backtradercpp {
         adj_data.resize(assets);
         volume.resize(assets);
         valid.resize(assets);
+        num_data_.resize(num_data_.rows(), assets);
+        str_data_.resize(str_data_.rows(), assets);
     }
     inline void backtradercpp::PriceFeedData::reset() {
         data.reset();
         adj_data.reset();
         valid.setConstant(false);
 
-        util::reset_value(num_data_, 0.0);
-        util::reset_value(str_data_, std::string());
+        num_data_.setZero();
+        str_data_.setZero();
+    }
+    inline void PriceFeedData::reset_asset(int asset) {
+        data.reset_asset(asset);
+        adj_data.reset_asset(asset);
+        valid.coeffRef(asset) = false;
+
+        num_data_.col(asset).setZero();
+        str_data_.col(asset).setZero();
     }
     inline void PriceFeedData::validate_assets() {
         valid = (data.open > 0) && (data.high > 0) && (data.low > 0) && (data.close > 0);
     }
+    inline void PriceFeedData::validate_asset(int asset) {
+        valid.coeffRef(asset) = (data.open.coeff(asset) > 0) && (data.high.coeff(asset) > 0) &&
+            (data.low.coeff(asset) > 0) && (data.close.coeff(asset) > 0);
+    }
 
-#define BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(data, var, fun)                                \
-    inline VecArrXd PriceFeedDataBuffer::fun(int time) const {                                     \
-        return data_[window_ + time].data.var;                                                     \
+#define BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(field, fun)                                    \
+    inline Eigen::Map<const VecArrXd> PriceFeedDataBuffer::fun(int time) const {                   \
+        const double* ring = price_(PriceField::field);                                            \
+        return Eigen::Map<const VecArrXd>(ring + row_(time) * stride_, assets_);                   \
     };                                                                                             \
     inline double PriceFeedDataBuffer::fun(int time, int stock) const {                            \
-        return data_[window_ + time].data.var.coeff(stock);                                        \
+        return price_(PriceField::field)[row_(time) * stride_ + stock];                            \
     }                                                                                              \
-    inline VecArrXd PriceFeedDataBuffer::fun(Sel s, int stock) const {                             \
-        VecArrXd res(window_);                                                                     \
-        for (int i = 0; i < data_.size(); ++i) {                                                   \
-            res.coeffRef(i) = data_[i].data.var.coeff(stock);                                      \
-        }                                                                                          \
-        return res;                                                                                \
+    inline PriceFeedDataBuffer::Column PriceFeedDataBuffer::fun(Sel, int stock) const {            \
+        const double* ring = price_(PriceField::field);                                            \
+        return Column(ring + row_(-window_) * stride_ + stock, window_,                            \
+            Eigen::InnerStride<>(stride_));                                                        \
     }                                                                                              \
-    template <typename Ret> inline Ret PriceFeedDataBuffer::fun(Sel r, Sel c) const {              \
-        Ret res(window_, assets_);                                                                 \
-        for (int i = 0; i < data_.size(); ++i) {                                                   \
-            res.row(i) = data_[i].data.var.transpose();                                            \
-        }                                                                                          \
-        return res;                                                                                \
+    template <typename Ret> inline Ret PriceFeedDataBuffer::fun(Sel, Sel) const {                  \
+        const double* ring = price_(PriceField::field);                                            \
+        return Ret(Window(ring + row_(-window_) * stride_, window_, assets_,                       \
+            Eigen::OuterStride<>(stride_)));                                                       \
     }
 #define BK_DEFINE_STRATEGYDATA_MEMBER_ACCESSOR(type1, type2, var)                                  \
-    inline type1 PriceFeedDataBuffer::var(int time) const { return data_[window_ + time].var; };   \
+    inline Eigen::Map<const type1> PriceFeedDataBuffer::var(int time) const {                      \
+        return Eigen::Map<const type1>(var##_.data() + row_(time) * assets_, assets_);             \
+    };                                                                                             \
     inline type2 PriceFeedDataBuffer::var(int time, int stock) const {                             \
-        return data_[window_ + time].var.coeff(stock);                                             \
+        return var##_.coeff(row_(time), stock);                                                    \
     }
 
     inline PriceFeedDataBuffer::PriceFeedDataBuffer(int assets, int window)
-        : FeedDataBuffer(window), assets_(assets) {
+        : window_(window), assets_(assets) {
+        std::tie(rows_, stride_) = ring_shape_(window, assets);
+        for (auto& ring : prices_) {
+            ring.allocate(sizeof(double) * rows_ * stride_);
+        }
+        times_.assign(rows_, boost::posix_time::min_date_time);
+        volume_.setZero(rows_, assets);
+        valid_.setConstant(rows_, assets, false);
+        num_.resize(rows_, 0);
+        str_.resize(rows_, 0);
     };
     inline backtradercpp::PriceFeedDataBuffer::PriceFeedDataBuffer(const PriceFeedData& data,
         int window)
-        : FeedDataBuffer(window), assets_(data.volume.size()) {
-        data_.push_back(data);
-    }
-    // const FeedData &PriceFeedDataBuffer::data(int time) const
-
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(data, open, open);
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(data, high, high);
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(data, low, low);
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(data, close, close);
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(data, ret, ret);
-
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(adj_data, open, adj_open);
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(adj_data, high, adj_high);
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(adj_data, low, adj_low);
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(adj_data, close, adj_close);
-    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(adj_data, ret, adj_ret);
+        : PriceFeedDataBuffer(data.volume.size(), window) {
+        schema_ = data.schema;
+        push_back_();
+    }
+
+    inline std::pair<int, int> PriceFeedDataBuffer::ring_shape_(int window, int assets) {
+        // Rows are a multiple of a power of two near window / 8, so that a few doubles of padding
+        // per row make whole pages. Both add about 1/8 of the ring at most, or a few pages. Last bar
+        // is kept for derived fields even if window is 1.
+        window = std::max(window, 2);
+        int unit = std::bit_floor(static_cast<unsigned>(std::max(window / 8, 1)));
+        int rows = (window + unit - 1) / unit * unit;
+        int page = util::MirroredBuffer::granularity() / sizeof(double);
+        int pad = page / std::gcd(page, rows);
+        return { rows, (assets + pad - 1) / pad * pad };
+    }
+
+    inline void PriceFeedDataBuffer::set_window(int window) {
+        auto [rows, stride] = ring_shape_(window, assets_);
+        for (int f = 0; f < price_fields_; ++f) {
+            util::MirroredBuffer ring(sizeof(double) * rows * stride);
+            auto data = reinterpret_cast<double*>(ring.data());
+            rewindow_(price_ring_(f), Eigen::Map<RowArrayXd, 0, Eigen::OuterStride<>>(data, rows,
+                assets_, Eigen::OuterStride<>(stride)));
+            prices_[f] = std::move(ring);
+        }
+        volume_ = rewindow_(volume_, rows);
+        valid_ = rewindow_(valid_, rows);
+        num_ = rewindow_(num_, rows);
+        str_ = rewindow_(str_, rows);
+        std::vector<ptime> times(rows, boost::posix_time::min_date_time);
+        for (int j = 1; j <= std::min(rows, rows_); ++j) {
+            times[rows - j] = times_[row_(-j)];
+        }
+        times_ = std::move(times);
+
+        window_ = window;
+        rows_ = rows;
+        stride_ = stride;
+        next_ = 0;
+    }
+    template <typename Ring, typename Res>
+    inline void PriceFeedDataBuffer::rewindow_(const Ring& ring, Res&& res) const {
+        for (int j = 1; j <= std::min<int>(res.rows(), rows_); ++j) {
+            res.row(res.rows() - j) = ring.row(row_(-j));
+        }
+    }
+    template <typename Ring>
+    inline Ring PriceFeedDataBuffer::rewindow_(const Ring& ring, int rows) const {
+        Ring res = Ring::Zero(rows, ring.cols());
+        rewindow_(ring, std::move(res));
+        return res;
+    }
+
+    template <typename T, typename Vec>
+    inline void PriceFeedDataBuffer::set_row_(T* row, int size, const Vec& v) {
+        if (v.size() == size) {
+            std::copy_n(v.data(), size, row);
+        }
+        else {
+            std::fill_n(row, size, T());
+        }
+    }
+
+    inline int PriceFeedDataBuffer::advance_() {
+        int r = next_;
+        next_ = (next_ + 1) % rows_;
+        return r;
+    }
+
+    inline void PriceFeedDataBuffer::push_back(const PriceFeedData& new_data) {
+        // Extra columns may be added after the buffer is created.
+        if (new_data.schema != schema_ && new_data.schema != nullptr) {
+            schema_ = new_data.schema;
+        }
+        if (new_data.num_data_.size() > num_.cols()) {
+            num_.conservativeResizeLike(RowArrayXd::Zero(rows_, new_data.num_data_.size()));
+        }
+        if (new_data.str_data_.size() > str_.cols()) {
+            str_.conservativeResizeLike(RowArrayXi::Zero(rows_, new_data.str_data_.size()));
+        }
+
+        int last = row_(-1), r = advance_();
+        const OHLCData* ohlc[] = { &new_data.data, &new_data.adj_data };
+        for (int k = 0; k < 2; ++k) {
+            int f = k * AdjOpen;
+            set_row_(price_row_(f + Open, r), assets_, ohlc[k]->open);
+            set_row_(price_row_(f + High, r), assets_, ohlc[k]->high);
+            set_row_(price_row_(f + Low, r), assets_, ohlc[k]->low);
+            set_row_(price_row_(f + Close, r), assets_, ohlc[k]->close);
+        }
+        set_row_(volume_.row(r).data(), assets_, new_data.volume);
+        set_row_(valid_.row(r).data(), assets_, new_data.valid);
+        times_[r] = new_data.time;
+        num_.row(r).setZero();
+        num_.row(r).head(new_data.num_data_.size()) =
+            Eigen::Map<const Eigen::Array<double, 1, Eigen::Dynamic>>(new_data.num_data_.data(),
+                new_data.num_data_.size());
+        str_.row(r).setZero();
+        str_.row(r).head(new_data.str_data_.size()) =
+            Eigen::Map<const Eigen::Array<int, 1, Eigen::Dynamic>>(new_data.str_data_.data(),
+                new_data.str_data_.size());
+
+        for (const auto& d : derived_fields_()) {
+            d.derive(*this, d.adj, r, last, Eigen::Map<VecArrXd>(price_row_(d.field, r), assets_));
+        }
+    }
+
+    inline std::span<const PriceFeedDataBuffer::DerivedField>
+    PriceFeedDataBuffer::derived_fields_() {
+        // Masked by valid flags of both bars rather than branching per asset. Prices of an invalid
+        // asset are not used, they may be anything a feed has left. Valid flags are of raw prices,
+        // so adjusted ones are also checked.
+        static constexpr auto ret = [](const PriceFeedDataBuffer& b, int adj, int r, int last,
+                                        Eigen::Map<VecArrXd> res) {
+            auto c = b.bar_(adj + Close, r), p = b.bar_(adj + Close, last);
+            res = (b.valid_row_(r) && b.valid_row_(last) && c.min(p) > 0).select(c / p - 1, 0.0);
+        };
+        static constexpr auto log_ret = [](const PriceFeedDataBuffer& b, int adj, int r, int last,
+                                            Eigen::Map<VecArrXd> res) {
+            auto c = b.bar_(adj + Close, r), p = b.bar_(adj + Close, last);
+            res = (b.valid_row_(r) && b.valid_row_(last) && c.min(p) > 0)
+                      .select((c / p).log(), 0.0);
+        };
+        static constexpr auto gap = [](const PriceFeedDataBuffer& b, int adj, int r, int last,
+                                        Eigen::Map<VecArrXd> res) {
+            auto o = b.bar_(adj + Open, r), p = b.bar_(adj + Close, last);
+            res = (b.valid_row_(r) && b.valid_row_(last) && o.min(p) > 0).select(o / p - 1, 0.0);
+        };
+        static constexpr auto true_range = [](const PriceFeedDataBuffer& b, int adj, int r,
+                                               int last, Eigen::Map<VecArrXd> res) {
+            auto h = b.bar_(adj + High, r), l = b.bar_(adj + Low, r), p = b.bar_(adj + Close, last);
+            res = b.valid_row_(r).select(
+                b.valid_row_(last).select(h.max(p) - l.min(p), h - l), 0.0);
+        };
+        static constexpr DerivedField fields[] = {
+            { Ret, 0, ret },
+            { LogRet, 0, log_ret },
+            { AdjRet, AdjOpen, ret },
+            { AdjLogRet, AdjOpen, log_ret },
+            { Gap, 0, gap },
+            { TrueRange, 0, true_range },
+        };
+        return fields;
+    }
+
+    inline void PriceFeedDataBuffer::push_back_() {
+        int r = advance_();
+        for (int f = 0; f < price_fields_; ++f) {
+            std::fill_n(price_row_(f, r), assets_, 0.0);
+        }
+        volume_.row(r).setZero();
+        valid_.row(r).setConstant(false);
+        times_[r] = boost::posix_time::min_date_time;
+        num_.row(r).setZero();
+        str_.row(r).setZero();
+    }
+
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(Open, open);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(High, high);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(Low, low);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(Close, close);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(Ret, ret);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(LogRet, log_ret);
+
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(AdjOpen, adj_open);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(AdjHigh, adj_high);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(AdjLow, adj_low);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(AdjClose, adj_close);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(AdjRet, adj_ret);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(AdjLogRet, adj_log_ret);
+
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(Gap, gap);
+    BK_DEFINE_STRATEGYDATA_OHLC_MEMBER_ACCESSOR(TrueRange, true_range);
 
     BK_DEFINE_STRATEGYDATA_MEMBER_ACCESSOR(VecArrXi, int, volume);
     BK_DEFINE_STRATEGYDATA_MEMBER_ACCESSOR(VecArrXb, bool, valid);
@@ -0,0 +1,365 @@
+#pragma once
+
+#include "MemoryUtil.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef BK_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef BK_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace backtradercpp {
+    namespace util {
+        // A job for BackgroundWorker. A job that hasn't started can be run by its owner instead, so an
+        // owner never waits behind jobs of others.
+        class BackgroundJob {
+        public:
+            explicit BackgroundJob(std::function<void()> fn) : fn_(std::move(fn)) {}
+
+            // Run job if no one has started it. Return false if it has been started.
+            bool try_run();
+            // Run job if it hasn't started, otherwise wait until it is done.
+            void run_or_wait() {
+                if (!try_run()) {
+                    wait_();
+                }
+            }
+            // Skip job if it hasn't started, otherwise wait until it is done.
+            void cancel() {
+                int expected = Pending;
+                if (!state_.compare_exchange_strong(expected, Done)) {
+                    wait_();
+                }
+            }
+
+        private:
+            enum State { Pending, Running, Done };
+            void wait_() {
+                std::unique_lock lock(mutex_);
+                done_.wait(lock, [&] { return state_.load() == Done; });
+            }
+
+            std::function<void()> fn_;
+            std::atomic<int> state_{ Pending };
+            std::mutex mutex_;
+            std::condition_variable done_;
+        };
+
+        // One process wide helper thread, e.g. to decompress next block of files while current block
+        // is parsed. Jobs whose owner is gone are skipped.
+        class BackgroundWorker {
+        public:
+            static void post(const std::shared_ptr<BackgroundJob>& job);
+
+        private:
+            BackgroundWorker() : thread_([this] { loop_(); }) {}
+            ~BackgroundWorker();
+            static BackgroundWorker& instance_() {
+                static BackgroundWorker worker;
+                return worker;
+            }
+            void loop_();
+
+            std::mutex mutex_;
+            std::condition_variable cv_;
+            std::deque<std::weak_ptr<BackgroundJob>> jobs_;
+            bool stop_ = false;
+            std::thread thread_;
+        };
+
+        // Sequential reader of a gzip (.gz) or zstd (.zst) file. The compressed file is memory mapped,
+        // so it doesn't hold a file descriptor, and the next block is decompressed in background while
+        // current one is used. Gzip needs BK_WITH_ZLIB and zstd needs BK_WITH_ZSTD to be defined, with
+        // zlib or libzstd linked.
+        class CompressedStream {
+        public:
+            enum class Codec { None, Gzip, Zstd };
+            // Codec of file by its extension.
+            static Codec codec_of(const std::string& file);
+
+            CompressedStream(const std::string& file, std::size_t block_size);
+            CompressedStream(const CompressedStream&) = delete;
+            CompressedStream& operator=(const CompressedStream&) = delete;
+            ~CompressedStream();
+
+            // Append next block of decompressed data to buf. Return false if all data has been read.
+            bool read(std::string& buf);
+            void rewind();
+
+        private:
+            void init_decoder_();
+            void free_decoder_();
+            // Decompress at most n bytes into out. Return number of bytes, 0 at end of data.
+            std::size_t decode_(char* out, std::size_t n);
+            // Decompress next block into next_, in background.
+            void prefetch_();
+
+            MappedFile file_;
+            std::string file_name_;
+            Codec codec_ = Codec::None;
+            std::size_t block_size_ = 0;
+            std::size_t in_pos_ = 0; // Compressed bytes consumed.
+
+#ifdef BK_WITH_ZLIB
+            std::unique_ptr<z_stream> zs_ = nullptr;
+            bool gz_ended_ = false; // Current gzip member is decoded to its end.
+#endif
+#ifdef BK_WITH_ZSTD
+            ZSTD_DStream* ds_ = nullptr;
+            std::size_t zstd_hint_ = 0; // 0 if last frame is decoded and flushed.
+#endif
+
+            std::string next_;
+            std::exception_ptr error_ = nullptr;
+            std::shared_ptr<BackgroundJob> job_ = nullptr;
+        };
+
+        inline bool BackgroundJob::try_run() {
+            int expected = Pending;
+            if (!state_.compare_exchange_strong(expected, Running)) {
+                return false;
+            }
+            fn_();
+            {
+                std::lock_guard lock(mutex_);
+                state_.store(Done);
+            }
+            done_.notify_all();
+            return true;
+        }
+
+        inline void BackgroundWorker::post(const std::shared_ptr<BackgroundJob>& job) {
+            auto& w = instance_();
+            {
+                std::lock_guard lock(w.mutex_);
+                w.jobs_.push_back(job);
+            }
+            w.cv_.notify_one();
+        }
+
+        inline BackgroundWorker::~BackgroundWorker() {
+            {
+                std::lock_guard lock(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_one();
+            thread_.join();
+        }
+
+        inline void BackgroundWorker::loop_() {
+            while (true) {
+                std::shared_ptr<BackgroundJob> job;
+                {
+                    std::unique_lock lock(mutex_);
+                    cv_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+                    if (stop_) {
+                        return;
+                    }
+                    job = jobs_.front().lock();
+                    jobs_.pop_front();
+                }
+                if (job != nullptr) {
+                    job->try_run();
+                }
+            }
+        }
+
+        inline CompressedStream::Codec CompressedStream::codec_of(const std::string& file) {
+            auto ext = std::filesystem::path(file).extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(),
+                [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (ext == ".gz") {
+                return Codec::Gzip;
+            }
+            if (ext == ".zst") {
+                return Codec::Zstd;
+            }
+            return Codec::None;
+        }
+
+        inline CompressedStream::CompressedStream(const std::string& file, std::size_t block_size)
+            : file_name_(file), codec_(codec_of(file)),
+            block_size_(std::max<std::size_t>(block_size, 1)) {
+#ifndef BK_WITH_ZLIB
+            if (codec_ == Codec::Gzip) {
+                throw std::runtime_error(
+                    "Reading " + file + " needs zlib, define BK_WITH_ZLIB and link zlib.");
+            }
+#endif
+#ifndef BK_WITH_ZSTD
+            if (codec_ == Codec::Zstd) {
+                throw std::runtime_error(
+                    "Reading " + file + " needs zstd, define BK_WITH_ZSTD and link libzstd.");
+            }
+#endif
+            if (codec_ == Codec::None) {
+                throw std::runtime_error(file + " is not a .gz or .zst file.");
+            }
+            file_.open(file);
+            init_decoder_();
+            prefetch_();
+        }
+
+        inline CompressedStream::~CompressedStream() {
+            if (job_ != nullptr) {
+                job_->cancel();
+            }
+            free_decoder_();
+        }
+
+        inline bool CompressedStream::read(std::string& buf) {
+            job_->run_or_wait();
+            if (error_ != nullptr) {
+                std::rethrow_exception(error_);
+            }
+            if (next_.empty()) {
+                return false;
+            }
+            buf += next_;
+            prefetch_();
+            return true;
+        }
+
+        inline void CompressedStream::rewind() {
+            job_->cancel();
+            free_decoder_();
+            in_pos_ = 0;
+            error_ = nullptr;
+            init_decoder_();
+            prefetch_();
+        }
+
+        inline void CompressedStream::prefetch_() {
+            job_ = std::make_shared<BackgroundJob>([this] {
+                try {
+                    next_.resize(block_size_);
+                    next_.resize(decode_(next_.data(), block_size_));
+                }
+                catch (...) {
+                    next_.clear();
+                    error_ = std::current_exception();
+                }
+            });
+            BackgroundWorker::post(job_);
+        }
+
+        inline void CompressedStream::init_decoder_() {
+#ifdef BK_WITH_ZLIB
+            if (codec_ == Codec::Gzip) {
+                zs_ = std::make_unique<z_stream>();
+                // 32 to detect gzip or zlib header.
+                if (inflateInit2(zs_.get(), 15 + 32) != Z_OK) {
+                    throw std::runtime_error("Can't initialize zlib for " + file_name_ + ".");
+                }
+                gz_ended_ = false;
+            }
+#endif
+#ifdef BK_WITH_ZSTD
+            if (codec_ == Codec::Zstd) {
+                ds_ = ZSTD_createDStream();
+                if (ds_ == nullptr || ZSTD_isError(ZSTD_initDStream(ds_))) {
+                    throw std::runtime_error("Can't initialize zstd for " + file_name_ + ".");
+                }
+                zstd_hint_ = 0;
+            }
+#endif
+        }
+
+        inline void CompressedStream::free_decoder_() {
+#ifdef BK_WITH_ZLIB
+            if (zs_ != nullptr) {
+                inflateEnd(zs_.get());
+                zs_ = nullptr;
+            }
+#endif
+#ifdef BK_WITH_ZSTD
+            if (ds_ != nullptr) {
+                ZSTD_freeDStream(ds_);
+                ds_ = nullptr;
+            }
+#endif
+        }
+
+        // Without codecs built in, nothing is decoded and all arguments are unused.
+        inline std::size_t CompressedStream::decode_([[maybe_unused]] char* out,
+            [[maybe_unused]] std::size_t n) {
+            [[maybe_unused]] const char* in = file_.data();
+            [[maybe_unused]] std::size_t in_size = file_.size();
+#ifdef BK_WITH_ZLIB
+            if (codec_ == Codec::Gzip) {
+                auto& zs = *zs_;
+                zs.next_out = reinterpret_cast<Bytef*>(out);
+                zs.avail_out = static_cast<uInt>(std::min<std::size_t>(n, 1u << 30));
+                uInt out_size = zs.avail_out;
+                while (zs.avail_out > 0) {
+                    if (zs.avail_in == 0) {
+                        if (in_pos_ == in_size) {
+                            if (!gz_ended_ && in_size > 0) {
+                                throw std::runtime_error("Truncated gzip file " + file_name_ + ".");
+                            }
+                            break;
+                        }
+                        auto chunk = std::min<std::size_t>(in_size - in_pos_, 1u << 30);
+                        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in + in_pos_));
+                        zs.avail_in = static_cast<uInt>(chunk);
+                        in_pos_ += chunk;
+                    }
+                    int ret = inflate(&zs, Z_NO_FLUSH);
+                    if (ret == Z_STREAM_END) {
+                        gz_ended_ = true;
+                        if (zs.avail_in == 0 && in_pos_ == in_size) {
+                            break;
+                        }
+                        inflateReset(&zs); // Concatenated gzip members.
+                        gz_ended_ = false;
+                    }
+                    else if (ret == Z_BUF_ERROR && in_pos_ == in_size) {
+                        throw std::runtime_error("Truncated gzip file " + file_name_ + ".");
+                    }
+                    else if (ret != Z_OK) {
+                        throw std::runtime_error("Corrupted gzip file " + file_name_ + ".");
+                    }
+                }
+                return out_size - zs.avail_out;
+            }
+#endif
+#ifdef BK_WITH_ZSTD
+            if (codec_ == Codec::Zstd) {
+                ZSTD_outBuffer o{ out, n, 0 };
+                ZSTD_inBuffer i{ in, in_size, in_pos_ };
+                while (o.pos < o.size) {
+                    if (i.pos == i.size && zstd_hint_ == 0) {
+                        break; // All frames are decoded and flushed.
+                    }
+                    std::size_t out_before = o.pos;
+                    std::size_t ret = ZSTD_decompressStream(ds_, &o, &i);
+                    if (ZSTD_isError(ret)) {
+                        throw std::runtime_error("Corrupted zstd file " + file_name_ + ": " +
+                            ZSTD_getErrorName(ret));
+                    }
+                    zstd_hint_ = ret;
+                    if (i.pos == i.size && o.pos == out_before && zstd_hint_ != 0) {
+                        throw std::runtime_error("Truncated zstd file " + file_name_ + ".");
+                    }
+                }
+                in_pos_ = i.pos;
+                return o.pos;
+            }
+#endif
+            return 0;
+        }
+    } // namespace util
+} // namespace backtradercpp
@@ -2,9 +2,15 @@
 /*ZhouYao at 2022-09-10*/
 
 #include "Common.hpp"
+#include "CSVParser.hpp"
+#include "DatasetStore.hpp"
+#include "EventTable.hpp"
+#include "PricePanel.hpp"
+#include "TickFile.hpp"
+#include "TimeIndex.hpp"
+#include "TimeParser.hpp"
 #include "util.hpp"
 #include <fstream>
-#include <boost/tokenizer.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <functional>
 #include "util.hpp"
@@ -19,27 +25,7 @@ namespace backtradercpp {
     namespace feeds {
         // CSVTabularDataImpl: A single matrix that contains multiple assets and only one type price. At
         // this case, OHLC are the same value and valume are implicitly very large. time_converter: convert
-        // a time string to standard format: 2020-01-01 01:00:00
-
-        struct TimeStrConv {
-            using func_type = std::function<std::string(const std::string&)>;
-
-            //"20100202"
-            static std::string non_delimited_date(const std::string& date_str) {
-                std::string res_date = "0000-00-00 00:00:00";
-                res_date.replace(0, 4, std::string_view{ date_str.data(), 4 });
-                res_date.replace(5, 2, std::string_view{ date_str.data() + 4, 2 });
-                res_date.replace(8, 2, std::string_view{ date_str.data() + 6, 2 });
-                return res_date;
-            }
-            static std::string delimited_date(const std::string& date_str) {
-                std::string res_date = "0000-00-00 00:00:00";
-                res_date.replace(0, 4, std::string_view{ date_str.data(), 4 });
-                res_date.replace(5, 2, std::string_view{ date_str.data() + 5, 2 });
-                res_date.replace(8, 2, std::string_view{ date_str.data() + 8, 2 });
-                return res_date;
-            }
-        };
+        // a time string to standard format: 2020-01-01 01:00:00, or a TimeFormat, see TimeParser.
 
         template <typename DataT, typename FeedT, typename BufferT> class GenericFeedsAggragator;
 
@@ -52,7 +38,7 @@ namespace backtradercpp {
         template <typename T> class GenericDataImpl {
         public:
             GenericDataImpl() = default;
-            explicit GenericDataImpl(TimeStrConv::func_type time_converter)
+            explicit GenericDataImpl(TimeParser time_converter)
                 : time_converter_(time_converter) {
             }
 
@@ -69,16 +55,27 @@ namespace backtradercpp {
             const auto& next() const { return next_; }
 
             virtual void reset() { finished_ = false; }
+            // Skip rows before time but keep at least `history` of them, so windows can be filled.
+            // Must be called before the first read() or after reset(). By default nothing is skipped.
+            virtual void seek(const ptime&, int) {}
 
             void set_name(const std::string& name) { name_ = name; }
             const auto& name() { return name_; }
 
+            // Cells that are empty or not numbers.
+            const ParseErrors& parse_errors() const { return parse_errors_; }
+
         protected:
-            TimeStrConv::func_type time_converter_;
+            // Parse a numeric cell in current row of reader and record failure.
+            double parse_cell_(const CSVReader& reader, int col,
+                double bad_value = std::numeric_limits<double>::quiet_NaN());
+
+            TimeParser time_converter_;
 
             T next_;
             bool finished_ = false;
             std::string name_;
+            ParseErrors parse_errors_;
 
             // if is_degenerated=true, then only close price is valid.
             // this can be useful for acceleration.
@@ -89,7 +86,7 @@ namespace backtradercpp {
 
         public:
             BasePriceDataImpl() = default;
-            explicit BasePriceDataImpl(TimeStrConv::func_type time_converter)
+            explicit BasePriceDataImpl(TimeParser time_converter)
                 : GenericDataImpl(time_converter) {
             };
             explicit BasePriceDataImpl(int n_assets)
@@ -105,59 +102,118 @@ namespace backtradercpp {
             int assets() const { return assets_; }
             const auto& codes() const { return codes_; }
 
-            // void reset() override{}
+            void reset() override {
+                GenericDataImpl::reset();
+                rewind_adj_factors_();
+            }
             virtual std::shared_ptr<BasePriceDataImpl> clone();
 
+            // Compute adjusted prices as raw prices times the latest adjustment factor of the asset at
+            // or before the bar, instead of reading adjusted data. Factor is the first field of
+            // events, and is 1 before the first event of an asset.
+            void adj_factors(std::shared_ptr<const EventTable> factors) {
+                adj_factors_ = std::move(factors);
+                factor_assets_.clear();
+                rewind_adj_factors_();
+            }
+
         protected:
             friend class FeedsAggragator;
 
             virtual void init() { print(fg(fmt::color::yellow), "Total {} assets.\n", assets_); }
 
+            // Multiply adjusted prices of next_, which are raw prices, by factors up to next_.time.
+            void apply_adj_factors_();
+            void rewind_adj_factors_() {
+                factor_next_ = 0;
+                factor_.setOnes(assets_);
+            }
+
             int assets_ = 0;
             std::vector<std::string> codes_;
+
+            std::shared_ptr<const EventTable> adj_factors_ = nullptr;
+            std::vector<int> factor_assets_; // Asset of each code of factors, mapped on first use.
+            VecArrXd factor_;
+            int factor_next_ = 0; // First factor not applied.
         };
 
         struct CSVRowParaser {
-            inline static boost::escaped_list_separator<char> esc_list_sep{ "", ",", "\"\'" };
             static std::vector<std::string> parse_row(const std::string& row);
 
-            static double parse_double(const std::string& ele);
+            // Return bad_value if ele is not a number.
+            static double parse_double(std::string_view ele,
+                double bad_value = std::numeric_limits<double>::quiet_NaN());
         };
 
-        // For tabluar pricing data. OHLC are the same.
+        // Select assets by code. nullptr selects all assets.
+        using CodeFilter = std::function<bool(const std::string&)>;
+        // Select assets whose codes are in the list.
+        inline CodeFilter codes_in(const std::vector<std::string>& codes) {
+            auto set = std::make_shared<std::unordered_set<std::string>>(codes.begin(), codes.end());
+            return [set](const std::string& code) { return set->contains(code); };
+        }
+
+        // For tabluar pricing data. OHLC are the same. If code_filter is set, only columns of selected
+        // assets are parsed.
         class CSVTabDataImpl : public BasePriceDataImpl {
         public:
             CSVTabDataImpl(const std::string& raw_data_file,
-                TimeStrConv::func_type time_converter = nullptr);
+                TimeParser time_converter = nullptr, CodeFilter code_filter = nullptr);
             // You have to ensure that two file have the same rows.
             CSVTabDataImpl(const std::string& raw_data_file, const std::string& adjusted_data_file,
-                TimeStrConv::func_type time_converter = nullptr);
+                TimeParser time_converter = nullptr, CodeFilter code_filter = nullptr);
             CSVTabDataImpl(const CSVTabDataImpl& impl_);
 
             bool read() override;
             void reset() override {
                 BasePriceDataImpl::reset();
+                if (panel_ != nullptr) {
+                    panel_row_ = 0;
+                    return;
+                }
                 init();
             }
+            void seek(const ptime& time, int history) override;
             std::shared_ptr<BasePriceDataImpl> clone() override;
 
+            // Parse the whole file on first read, and serve bars from memory. The parsed data is
+            // shared by all feeds of the same file in the process (see DatasetStore), so clones and
+            // reset() don't read the file again.
+            CSVTabDataImpl& preload(bool on = true) {
+                preload_ = on;
+                return *this;
+            }
+
         private:
             void init() override;
-            void cast_ohlc_data_(std::vector<std::string>& row_string, OHLCData& dest);
+            void cast_ohlc_data_(const CSVReader& reader, OHLCData& dest);
+            // Whether adjusted prices are read from adjusted file, otherwise they are raw prices times
+            // adjustment factors.
+            bool separate_adj_() const {
+                return adj_factors_ == nullptr && adj_data_file_name_ != raw_data_file_name_;
+            }
 
-            std::ifstream raw_data_file_, adj_data_file_;
+            void load_panel_();
+            bool read_panel_();
+
+            CSVReader raw_data_file_, adj_data_file_;
             std::string raw_data_file_name_, adj_data_file_name_;
-            std::string next_row_, adj_next_row_;
+            CodeFilter code_filter_ = nullptr;
+
+            bool preload_ = false;
+            std::shared_ptr<const PricePanel> panel_ = nullptr;
+            int panel_row_ = 0;
         };
 
         class CSVDirDataImpl : public BasePriceDataImpl {
         public:
             // tohlc_map: column number of time, open, high, low, close
             CSVDirDataImpl(const std::string& raw_data_dir, std::array<int, 5> tohlc_map = { 0, 1, 2, 3, 4 },
-                TimeStrConv::func_type time_converter = nullptr);
+                TimeParser time_converter = nullptr);
             CSVDirDataImpl(const std::string& raw_data_dir, const std::string& adj_data_dir,
                 std::array<int, 5> tohlc_map = { 0, 1, 2, 3, 4 },
-                TimeStrConv::func_type time_converter = nullptr);
+                TimeParser time_converter = nullptr);
             CSVDirDataImpl(const CSVDirDataImpl& impl_);
 
             bool read() override;
@@ -169,55 +225,240 @@ namespace backtradercpp {
             CSVDirDataImpl& extra_str_col(const std::vector<std::pair<int, std::string>>& cols);
 
             CSVDirDataImpl& code_extractor(std::function<std::string(std::string)> fun) {
-                // this->code_extractor_ = fun;
+                code_extractor_ = fun;
                 for (auto& ele : codes_) {
                     ele = fun(ele);
                 }
                 return *this;
             }
 
+            // Convert all files into a binary file on first read, and map it in following runs. The
+            // cache is rebuilt if any data file changes. Note that a custom time_converter function
+            // is not tracked.
+            CSVDirDataImpl& cache_file(const std::string& file) {
+                cache_file_ = file;
+                return *this;
+            }
+
+            // Parse all files in parallel into a dense panel on first read, and serve bars from memory.
+            // Feeds of the same files and columns in the process share the panel (see DatasetStore),
+            // so clones and reset() don't read files again.
+            CSVDirDataImpl& preload(bool on = true) {
+                preload_ = on;
+                return *this;
+            }
+
+            // Keep at most `files` data files open and read each file by blocks of about block_size
+            // bytes, instead of mapping all files. For universes larger than the file limit.
+            CSVDirDataImpl& max_open_files(int files, std::size_t block_size = 1 << 14) {
+                max_open_files_ = files;
+                block_size_ = block_size;
+                return *this;
+            }
+
             // init() must be manunally called. Because in Cerebro::add_data_feed, the evaluation order of
             // data feed and broker are unspecified in C++ standard.
             void init() override;
             void reset() override {
-                raw_data_filenames.clear();
-                adj_data_filenames.clear();
-
-                raw_files.clear();
-                adj_files.clear();
-
+                BasePriceDataImpl::reset();
+                if (panel_ != nullptr) {
+                    panel_row_ = 0;
+                    return;
+                }
                 init();
             }
+            // Assets are seeked separately, so each one keeps at least `history` rows.
+            void seek(const ptime& time, int history) override;
             std::shared_ptr<BasePriceDataImpl> clone() override;
 
         private:
+            void open_files_();
+            // Whether adjusted prices are read from adjusted files, otherwise they are raw prices times
+            // adjustment factors.
+            bool separate_adj_() const { return adj_factors_ == nullptr && adj_data_dir != raw_data_dir; }
+            // Set schema and size of extra columns in next_.
+            void init_extra_cols_();
+            // Code of value s of string column j of asset i.
+            int str_code_(int j, int i, std::string_view s);
+            // Put first rows of all assets into queue.
+            void fill_queue_();
+            // Read next row of an asset and put it into queue.
+            void advance_(int i);
+            ptime parse_time_(std::string_view s) const { return time_converter_.parse(s); }
+            // time_parser is passed as TimeParser can't be shared by threads.
+            AssetSeries read_asset_series_(int i, const TimeParser& time_parser);
+
+            std::string cache_manifest_() const;
+            void load_panel_();
+            bool read_panel_();
+
             std::string raw_data_dir, adj_data_dir;
             std::vector<std::string> raw_data_filenames, adj_data_filenames;
 
             // std::vector<std::filesystem::path> raw_file_names, adj_file_names;
-            std::vector<std::ifstream> raw_files, adj_files;
-            std::vector<std::string> raw_line_buffer, adj_line_buffer;
-            std::vector<std::vector<std::string>> raw_parsed_buffer, adj_parsed_buffer;
+            std::vector<CSVReader> raw_files, adj_files;
             std::vector<std::array<double, 4>> raw_parsed_double_buffer, adj_parsed_double_buffer;
             std::array<int, 5> tohlc_map;
 
             std::vector<int> extra_num_col_, extra_str_col_;
             std::vector<std::string> extra_num_col_names_, extra_str_col_names_;
-            std::vector<std::reference_wrapper<VecArrXd>> extra_num_data_ref_;
-            std::vector<std::reference_wrapper<std::vector<std::string>>> extra_str_data_ref_;
 
-            std::vector<ptime> times;
+            std::function<std::string(std::string)> code_extractor_ = nullptr;
+
+            // Assets whose next row has been read, ordered by time.
+            using QueueItem = std::pair<ptime, int>;
+            std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue_;
+            std::vector<int> printed_; // Assets that have data in last bar.
+            bool files_opened_ = false;
+
+            int max_open_files_ = 0; // 0 for mapping all files.
+            std::size_t block_size_ = 1 << 14;
+            std::shared_ptr<util::FilePool> file_pool_ = nullptr;
+
+            bool preload_ = false;
+            std::string cache_file_;
+            std::shared_ptr<const PricePanel> panel_ = nullptr;
+            int panel_row_ = 0;
+            // Codes of panel string dictionaries in dictionaries of this feed, per column.
+            std::vector<std::vector<int>> panel_str_codes_;
+
+            // Last code of each string column and asset.
+            RowArrayXi str_last_;
+        };
+
+        // Price feed joined with point-in-time events as of each bar. A value of an event is seen from
+        // the first bar at or after its time, until the next event of the same asset and field. Fields
+        // of events are numeric columns after extra columns of the base feed, e.g. data(0).num("eps"),
+        // and are NaN before the first event. Latest values are kept in the bar, so a bar only costs
+        // its events besides copying the base bar.
+        class AsOfJoinDataImpl : public BasePriceDataImpl {
+        public:
+            explicit AsOfJoinDataImpl(std::shared_ptr<BasePriceDataImpl> base);
+            AsOfJoinDataImpl(const AsOfJoinDataImpl& impl_);
+
+            // Events of codes that are not assets of base feed are ignored. A field in several tables
+            // is one column.
+            AsOfJoinDataImpl& join(std::shared_ptr<const EventTable> events);
+
+            bool read() override;
+            void reset() override;
+            void seek(const ptime& time, int history) override;
+            std::shared_ptr<BasePriceDataImpl> clone() override;
+
+        private:
+            struct Source {
+                std::shared_ptr<const EventTable> events;
+                std::vector<int> assets; // Asset of each code of events, -1 if not found.
+                std::vector<int> fields; // Column of each field of events in fields_.
+                int next = 0;            // First event not applied.
+            };
+
+            // Map codes of events to assets of base feed, which may be changed after construction.
+            void map_assets_();
+            // Build schema of base schema and fields_.
+            void init_schema_(const std::shared_ptr<const FieldSchema>& base_schema);
+            void rewind_();
+
+            std::shared_ptr<BasePriceDataImpl> base_;
+            std::vector<Source> sources_;
+            std::vector<std::string> fields_;
+            bool assets_mapped_ = false;
+
+            // Schema of base bars that next_.schema is built from.
+            std::shared_ptr<const FieldSchema> base_schema_ = nullptr;
+            bool schema_init_ = false;
+            int base_num_ = 0; // Numeric columns of base feed.
+        };
+
+        // Period of resampled bars. Periods are counted from 1970-01-01 and weeks start on Monday, so
+        // e.g. BarPeriod::minutes(30) are half hours of a clock and BarPeriod::months(3) are quarters.
+        struct BarPeriod {
+            enum Unit { Minute, Hour, Day, Week, Month };
+            Unit unit = Day;
+            int n = 1;
+
+            static BarPeriod minutes(int n) { return make_(Minute, n); }
+            static BarPeriod hours(int n) { return make_(Hour, n); }
+            static BarPeriod days(int n) { return make_(Day, n); }
+            static BarPeriod weeks(int n = 1) { return make_(Week, n); }
+            static BarPeriod months(int n = 1) { return make_(Month, n); }
 
-            /* std::function<std::string(std::string)> code_extractor_ = [](const std::string &e) {
-                 return e;
-             };*/
+            // Index of the period of t, increasing with time.
+            int64_t key(const ptime& t) const;
+            // Start of the period of key.
+            ptime start(int64_t key) const;
 
-            std::vector<State> status; // Track if data in each file has been readed.
+        private:
+            static BarPeriod make_(Unit unit, int n);
+            int64_t micros_() const;
+        };
+
+        // A price feed resampled to coarser bars, e.g. daily bars to weekly ones, so strategy runs and
+        // windows hold one bar per period. A bar aggregates base bars of its period: open of the first
+        // valid bar, highest high, lowest low, close of the last valid bar and summed volume, returns
+        // follow from closes. An asset is valid if it is valid in any base bar, and extra columns are
+        // its latest valid values. A bar has the time of its last base bar, so it is seen when the
+        // period is over, which is known by reading the first base bar of next period.
+        class ResampledDataImpl : public BasePriceDataImpl {
+        public:
+            ResampledDataImpl(std::shared_ptr<BasePriceDataImpl> base, BarPeriod period);
+            ResampledDataImpl(const ResampledDataImpl& impl_);
+
+            bool read() override;
+            void reset() override;
+            // Base feed seeks to the start of the period `history` periods before time.
+            void seek(const ptime& time, int history) override;
+            std::shared_ptr<BasePriceDataImpl> clone() override;
+
+        private:
+            // Start next_ with a base bar, or add a base bar of the same period to it.
+            void start_(const PriceFeedData& bar);
+            void merge_(const PriceFeedData& bar);
+
+            std::shared_ptr<BasePriceDataImpl> base_;
+            BarPeriod period_;
+            bool pending_ = false;      // Base feed has read the first bar of next period.
+            bool codes_synced_ = false; // Codes of base feed may be changed after construction.
+            VecArrXb seen_;             // Assets valid in a base bar of current period.
+        };
+
+        // Bars built from ticks of a TickFile as they are read. Time bars cover periods and have the
+        // time their period ends. Volume bars end with the tick that makes their total size of all
+        // assets reach bar volume, and have the time of that tick. Assets without ticks in a bar are
+        // invalid and keep their last close. Adjusted prices are raw prices, or computed by
+        // adj_factors().
+        class TickDataImpl : public BasePriceDataImpl {
+        public:
+            TickDataImpl(const std::string& file, BarPeriod period);
+            TickDataImpl(const std::string& file, int64_t bar_volume);
+
+            // Bars carry their ticks, so broker fills orders by ticks, see PriceFeedData::ticks.
+            void intra_bar_ticks(bool on) { intra_bar_ticks_ = on; }
+
+            bool read() override;
+            void reset() override;
+            // Only time bars seek, to the start of the period `history` periods before time.
+            void seek(const ptime& time, int history) override;
+            std::shared_ptr<BasePriceDataImpl> clone() override;
+
+        private:
+            void init_(const std::string& file);
+            void rewind_(std::size_t pos);
+            // Add ticks from pos_ to next_ till the bar ends.
+            template <bool by_volume> void build_();
+
+            std::shared_ptr<const TickFile> file_;
+            BarPeriod period_;
+            int64_t bar_volume_ = 0; // Volume bars if > 0.
+            bool intra_bar_ticks_ = false;
+            std::size_t pos_ = 0; // Next tick.
+            int64_t end_ = 0;     // End of period of time bar.
+            std::vector<int64_t> volume_;
         };
 
         class BaseCommonDataFeedImpl : public GenericDataImpl<CommonFeedData> {
         public:
-            BaseCommonDataFeedImpl(TimeStrConv::func_type time_converter)
+            BaseCommonDataFeedImpl(TimeParser time_converter)
                 : GenericDataImpl(time_converter) {
             };
             BaseCommonDataFeedImpl(const BaseCommonDataFeedImpl& impl_) = default;
@@ -230,21 +471,23 @@ namespace backtradercpp {
 
         class CSVCommonDataImpl : public BaseCommonDataFeedImpl {
         public:
-            CSVCommonDataImpl(const std::string& file, TimeStrConv::func_type time_converter,
+            CSVCommonDataImpl(const std::string& file, TimeParser time_converter,
                 const std::vector<int> str_cols);
             CSVCommonDataImpl(const CSVCommonDataImpl& impl_);
             bool read() override;
             void reset() override { init(); }
+            void seek(const ptime& time, int history) override;
 
             std::shared_ptr<BaseCommonDataFeedImpl> clone() override;
 
         private:
             void init();
 
-            std::string file, next_row_;
+            std::string file;
             std::unordered_set<int> str_cols_;
-            std::vector<std::string> col_names_;
-            std::ifstream data_file_;
+            // Column numbers of numeric and string fields, in order of schema.
+            std::vector<int> num_fields_, str_fields_;
+            CSVReader data_file_;
         };
 
         // ---------------------------------------------------------------------------------
@@ -259,7 +502,9 @@ namespace backtradercpp {
             CommonFeedData* data_ptr() { return sp->data_ptr(); }
 
             virtual void reset() { sp->reset(); }
+            void seek(const ptime& time, int history) { sp->seek(time, history); }
             const auto& name() const { return sp->name(); }
+            const auto& parse_errors() const { return sp->parse_errors(); }
 
             BaseCommonDataFeed& set_name(const std::string& name) {
                 sp->set_name(name);
@@ -272,7 +517,7 @@ namespace backtradercpp {
         struct CSVCommonDataFeed : BaseCommonDataFeed {
             std::shared_ptr<CSVCommonDataImpl> sp;
 
-            CSVCommonDataFeed(const std::string& file, TimeStrConv::func_type time_converter = nullptr,
+            CSVCommonDataFeed(const std::string& file, TimeParser time_converter = nullptr,
                 const std::vector<int>& str_cols = {})
                 : sp(std::make_shared<CSVCommonDataImpl>(file, time_converter, str_cols)) {
                 set_base_sp();
@@ -292,6 +537,25 @@ namespace backtradercpp {
             }*/
         };
 
+        // Sparse events in a csv file, see EventTable. Wide file: tc_map is column number of time and
+        // code, other columns are fields. Long file: tcfv_map is column number of time, code, field
+        // name and value.
+        struct CSVEventData {
+            std::shared_ptr<const EventTable> sp;
+
+            CSVEventData(const std::string& file, TimeParser time_converter = nullptr,
+                std::array<int, 2> tc_map = { 0, 1 })
+                : sp(EventTable::read_csv(file, time_converter, tc_map[0], tc_map[1])) {
+            }
+            CSVEventData(const std::string& file, TimeParser time_converter,
+                std::array<int, 4> tcfv_map)
+                : sp(EventTable::read_csv(file, time_converter, tcfv_map[0], tcfv_map[1], tcfv_map[2],
+                    tcfv_map[3])) {
+            }
+
+            const auto& parse_errors() const { return sp->parse_errors(); }
+        };
+
         struct BasePriceDataFeed {
             BasePriceDataFeed() = default;
             explicit BasePriceDataFeed(std::shared_ptr<BasePriceDataImpl> sp) : sp(std::move(sp)) {}
@@ -300,6 +564,7 @@ namespace backtradercpp {
 
             bool read() { return sp->read(); }
             virtual void reset() { sp->reset(); }
+            void seek(const ptime& time, int history) { sp->seek(time, history); }
 
             PriceFeedData* data_ptr() { return sp->data_ptr(); }
             int assets() const { return sp->assets(); }
@@ -307,6 +572,7 @@ namespace backtradercpp {
             const auto& codes() const { return sp->codes(); }
 
             const auto& name() const { return sp->name(); }
+            const auto& parse_errors() const { return sp->parse_errors(); }
 
             BasePriceDataFeed& set_name(const std::string& name) {
                 sp->set_name(name);
@@ -320,14 +586,15 @@ namespace backtradercpp {
             std::shared_ptr<CSVTabDataImpl> sp = nullptr;
 
             CSVTabPriceData(const std::string& raw_data_file,
-                TimeStrConv::func_type time_converter = nullptr)
-                : sp(std::make_shared<CSVTabDataImpl>(raw_data_file, time_converter)) {
+                TimeParser time_converter = nullptr, CodeFilter code_filter = nullptr)
+                : sp(std::make_shared<CSVTabDataImpl>(raw_data_file, time_converter, code_filter)) {
                 set_base_sp();
             }
             // You have to ensure that two file have the same rows.
             CSVTabPriceData(const std::string& raw_data_file, const std::string& adjusted_data_file,
-                TimeStrConv::func_type time_converter = nullptr)
-                : sp(std::make_shared<CSVTabDataImpl>(raw_data_file, adjusted_data_file, time_converter)) {
+                TimeParser time_converter = nullptr, CodeFilter code_filter = nullptr)
+                : sp(std::make_shared<CSVTabDataImpl>(raw_data_file, adjusted_data_file, time_converter,
+                    code_filter)) {
                 set_base_sp();
             }
             explicit CSVTabPriceData(std::shared_ptr<CSVTabDataImpl> sp) : sp(std::move(sp)) {
@@ -336,6 +603,18 @@ namespace backtradercpp {
 
             bool read() { return sp->read(); }
 
+            CSVTabPriceData& set_preload(bool on = true) {
+                sp->preload(on);
+                return *this;
+            }
+
+            // Compute adjusted prices from factors instead of adjusted file, see
+            // BasePriceDataImpl::adj_factors.
+            CSVTabPriceData& set_adj_factors(const CSVEventData& factors) {
+                sp->adj_factors(factors.sp);
+                return *this;
+            }
+
             CSVTabPriceData& set_name(const std::string& name) {
                 BasePriceDataFeed::set_name(name);
                 return *this;
@@ -349,13 +628,13 @@ namespace backtradercpp {
             std::shared_ptr<CSVDirDataImpl> sp;
 
             CSVDirPriceData(const std::string& raw_data_dir, std::array<int, 5> tohlc_map = { 0, 1, 2, 3, 4 },
-                TimeStrConv::func_type time_converter = nullptr)
+                TimeParser time_converter = nullptr)
                 : sp(std::make_shared<CSVDirDataImpl>(raw_data_dir, tohlc_map, time_converter)) {
                 set_base_sp();
             }
             CSVDirPriceData(const std::string& raw_data_dir, const std::string& adj_data_dir,
                 std::array<int, 5> tohlc_map = { 0, 1, 2, 3, 4 },
-                TimeStrConv::func_type time_converter = nullptr)
+                TimeParser time_converter = nullptr)
                 : sp(std::make_shared<CSVDirDataImpl>(raw_data_dir, adj_data_dir, tohlc_map,
                     time_converter)) {
                 set_base_sp();
@@ -378,6 +657,28 @@ namespace backtradercpp {
                 return *this;
             }
 
+            CSVDirPriceData& set_cache_file(const std::string& file) {
+                sp->cache_file(file);
+                return *this;
+            }
+
+            CSVDirPriceData& set_preload(bool on = true) {
+                sp->preload(on);
+                return *this;
+            }
+
+            // Compute adjusted prices from factors instead of adjusted files, see
+            // BasePriceDataImpl::adj_factors.
+            CSVDirPriceData& set_adj_factors(const CSVEventData& factors) {
+                sp->adj_factors(factors.sp);
+                return *this;
+            }
+
+            CSVDirPriceData& set_max_open_files(int files, std::size_t block_size = 1 << 14) {
+                sp->max_open_files(files, block_size);
+                return *this;
+            }
+
             CSVDirPriceData& set_name(const std::string& name) {
                 BasePriceDataFeed::set_name(name);
                 return *this;
@@ -387,11 +688,107 @@ namespace backtradercpp {
             BasePriceDataFeed clone() { return BasePriceDataFeed(); }
         };
 
+        // A price feed with events joined as of each bar, see AsOfJoinDataImpl.
+        struct AsOfJoinPriceData : BasePriceDataFeed {
+            std::shared_ptr<AsOfJoinDataImpl> sp;
+
+            explicit AsOfJoinPriceData(const BasePriceDataFeed& base)
+                : sp(std::make_shared<AsOfJoinDataImpl>(base.sp)) {
+                set_base_sp();
+            }
+            explicit AsOfJoinPriceData(std::shared_ptr<AsOfJoinDataImpl> sp) : sp(std::move(sp)) {
+                set_base_sp();
+            }
+
+            AsOfJoinPriceData& join(const CSVEventData& events) {
+                sp->join(events.sp);
+                return *this;
+            }
+
+            AsOfJoinPriceData& set_name(const std::string& name) {
+                BasePriceDataFeed::set_name(name);
+                return *this;
+            }
+
+            void set_base_sp() { BasePriceDataFeed::sp = sp; }
+            BasePriceDataFeed clone() { return AsOfJoinPriceData(std::make_shared<AsOfJoinDataImpl>(*sp)); }
+        };
+
+        // A price feed resampled to coarser bars, see ResampledDataImpl. E.g.
+        // ResampledPriceData(daily, BarPeriod::weeks()).
+        struct ResampledPriceData : BasePriceDataFeed {
+            std::shared_ptr<ResampledDataImpl> sp;
+
+            ResampledPriceData(const BasePriceDataFeed& base, BarPeriod period)
+                : sp(std::make_shared<ResampledDataImpl>(base.sp, period)) {
+                set_base_sp();
+            }
+            explicit ResampledPriceData(std::shared_ptr<ResampledDataImpl> sp) : sp(std::move(sp)) {
+                set_base_sp();
+            }
+
+            ResampledPriceData& set_name(const std::string& name) {
+                BasePriceDataFeed::set_name(name);
+                return *this;
+            }
+
+            void set_base_sp() { BasePriceDataFeed::sp = sp; }
+            BasePriceDataFeed clone() {
+                return ResampledPriceData(std::make_shared<ResampledDataImpl>(*sp));
+            }
+        };
+
+        // Bars built from a tick file, see TickDataImpl. E.g. TickPriceData("trades.bin",
+        // BarPeriod::minutes(1)) for minute bars or TickPriceData("trades.bin", 10000) for bars of
+        // 10000 shares.
+        struct TickPriceData : BasePriceDataFeed {
+            std::shared_ptr<TickDataImpl> sp;
+
+            TickPriceData(const std::string& file, BarPeriod period)
+                : sp(std::make_shared<TickDataImpl>(file, period)) {
+                set_base_sp();
+            }
+            TickPriceData(const std::string& file, int64_t bar_volume)
+                : sp(std::make_shared<TickDataImpl>(file, bar_volume)) {
+                set_base_sp();
+            }
+            explicit TickPriceData(std::shared_ptr<TickDataImpl> sp) : sp(std::move(sp)) {
+                set_base_sp();
+            }
+
+            TickPriceData& set_intra_bar_ticks(bool on = true) {
+                sp->intra_bar_ticks(on);
+                return *this;
+            }
+
+            TickPriceData& set_adj_factors(const CSVEventData& factors) {
+                sp->adj_factors(factors.sp);
+                return *this;
+            }
+
+            TickPriceData& set_name(const std::string& name) {
+                BasePriceDataFeed::set_name(name);
+                return *this;
+            }
+
+            void set_base_sp() { BasePriceDataFeed::sp = sp; }
+            BasePriceDataFeed clone() { return TickPriceData(std::make_shared<TickDataImpl>(*sp)); }
+        };
+
         //-------------------------------------------------------------------
         template <typename DataT, typename FeedT, typename BufferT> class GenericFeedsAggragator {
         public:
             // GenericFeedsAggragator() = default;
 
+            // A bar read from feeds but not pushed into buffers yet. data has next data of all feeds,
+            // valid marks feeds that have data at time.
+            struct Bar {
+                bool ok = false; // false if all feeds are finished.
+                ptime time;
+                VecArrXb valid;
+                std::vector<DataT> data;
+            };
+
             const auto& datas() const { return data_; }
             const auto& datas_valid() const { return datas_valid_; }
             bool data_valid(int feed) const { return datas_valid_.coeff(feed); }
@@ -399,6 +796,7 @@ namespace backtradercpp {
             const auto& data(int i) const { return data_[i]; }
 
             const auto feed(int i) const { return feeds_[i]; }
+            const auto& feeds() const { return feeds_; }
 
             void add_feed(const FeedT& feed);
 
@@ -406,6 +804,15 @@ namespace backtradercpp {
             void reset();
             auto finished() const { return finished_; }
             bool read();
+            // Seek all feeds, see GenericDataImpl::seek. Feeds are read again from the new positions.
+            void seek(const ptime& time, int history);
+            // Largest window of all buffers.
+            int max_window() const;
+
+            // read() split in two steps. fetch() only touches feeds and commit() only touches buffers,
+            // so feeds can be read ahead in another thread.
+            bool fetch(Bar& bar);
+            void commit(const Bar& bar);
 
             auto data_ptr() { return &data_; }
             const auto& time() const { return time_; }
@@ -419,7 +826,13 @@ namespace backtradercpp {
             GenericFeedsAggragator clone();
 
         private:
-            std::vector<ptime> times_;
+            // Read feeds and find next time. Return false if all feeds are finished.
+            bool next_time_(ptime& time, VecArrXb& valid);
+
+            // Feeds whose next data has been read, ordered by time.
+            using QueueItem = std::pair<ptime, int>;
+            std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue_;
+            std::vector<int> to_read_; // Feeds consumed in last bar.
 
             std::vector<const DataT*> next_;
             std::vector<FeedT> feeds_;
@@ -427,7 +840,6 @@ namespace backtradercpp {
 
             VecArrXb datas_valid_;
 
-            std::vector<State> status_;
             bool finished_ = false;
             ptime time_ = boost::gregorian::min_date_time;
         };
@@ -451,54 +863,93 @@ namespace backtradercpp {
         //---------------------------------------------------------------
 
         std::vector<std::string> CSVRowParaser::parse_row(const std::string& row) {
-            boost::tokenizer<boost::escaped_list_separator<char>> tok(row, esc_list_sep);
-            std::vector<std::string> res;
-            for (auto beg = tok.begin(); beg != tok.end(); ++beg) {
-                res.emplace_back(*beg);
-            }
-            return res;
+            CSVRow parsed;
+            parsed.parse(row);
+            return std::vector<std::string>(parsed.fields().begin(), parsed.fields().end());
         }
-        double CSVRowParaser::parse_double(const std::string& ele) {
-            double res = std::numeric_limits<double>::quiet_NaN();
-            std::string s = boost::algorithm::trim_copy(ele);
-            try {
-                res = boost::lexical_cast<double>(s);
-            }
-            catch (...) {
-                util::cout("Bad cast: {}\n", ele);
+        double CSVRowParaser::parse_double(std::string_view ele, double bad_value) {
+            double res;
+            return feeds::parse_double(ele, res) == ParseStatus::Ok ? res : bad_value;
+        }
+
+        template <typename T>
+        inline double GenericDataImpl<T>::parse_cell_(const CSVReader& reader, int col, double bad_value) {
+            double res;
+            auto status = feeds::parse_double(reader.row()[col], res);
+            if (status == ParseStatus::Ok) {
+                return res;
             }
-            return res;
+            // Directory data is parsed in parallel, record() only locks for first failed cells.
+            parse_errors_.record(status, reader, col);
+            return bad_value;
         }
 
         std::shared_ptr<BasePriceDataImpl> BasePriceDataImpl::clone() {
             return std::make_shared<BasePriceDataImpl>(*this);
         }
 
+        inline void BasePriceDataImpl::apply_adj_factors_() {
+            if (adj_factors_ == nullptr) {
+                return;
+            }
+            const auto& e = *adj_factors_;
+            if (factor_assets_.empty()) {
+                std::unordered_map<std::string, int> asset_index;
+                for (int i = 0; i < static_cast<int>(codes_.size()); ++i) {
+                    asset_index.emplace(codes_[i], i);
+                }
+                for (const auto& code : e.codes()) {
+                    auto it = asset_index.find(code);
+                    factor_assets_.push_back(it == asset_index.end() ? -1 : it->second);
+                }
+            }
+            if (factor_.size() != assets_) {
+                factor_.setOnes(assets_);
+            }
+            int64_t time = util::to_epoch_us(next_.time);
+            for (; factor_next_ < e.size() && e.time(factor_next_) <= time; ++factor_next_) {
+                int asset = factor_assets_[e.asset(factor_next_)];
+                if (asset >= 0 && e.field(factor_next_) == 0) {
+                    factor_.coeffRef(asset) = e.value(factor_next_);
+                }
+            }
+            next_.adj_data.open *= factor_;
+            next_.adj_data.high *= factor_;
+            next_.adj_data.low *= factor_;
+            next_.adj_data.close *= factor_;
+        }
+
         inline CSVTabDataImpl::CSVTabDataImpl(const std::string& raw_data_file,
-            TimeStrConv::func_type time_converter)
+            TimeParser time_converter, CodeFilter code_filter)
             : BasePriceDataImpl(time_converter), raw_data_file_name_(raw_data_file),
-            adj_data_file_name_(raw_data_file), raw_data_file_(raw_data_file),
-            adj_data_file_(raw_data_file) {
+            adj_data_file_name_(raw_data_file), code_filter_(std::move(code_filter)) {
             util::check_path_exists(raw_data_file);
             init();
         }
 
         CSVTabDataImpl::CSVTabDataImpl(const std::string& raw_data_file,
             const std::string& adjusted_data_file,
-            TimeStrConv::func_type time_converter)
-            : BasePriceDataImpl(time_converter) {
+            TimeParser time_converter, CodeFilter code_filter)
+            : BasePriceDataImpl(time_converter), code_filter_(std::move(code_filter)) {
             util::check_path_exists(raw_data_file);
             util::check_path_exists(adjusted_data_file);
 
             raw_data_file_name_ = raw_data_file;
-            adj_data_file_name_ = raw_data_file;
+            adj_data_file_name_ = adjusted_data_file;
             init();
         }
 
         inline CSVTabDataImpl::CSVTabDataImpl(const CSVTabDataImpl& impl_) : BasePriceDataImpl(impl_) {
             raw_data_file_name_ = impl_.raw_data_file_name_;
             adj_data_file_name_ = impl_.adj_data_file_name_;
-            init();
+            code_filter_ = impl_.code_filter_;
+            preload_ = impl_.preload_;
+            panel_ = impl_.panel_;
+            rewind_adj_factors_();
+            // Assets are copied, files are only needed without panel.
+            if (panel_ == nullptr) {
+                init();
+            }
         }
 
         inline std::shared_ptr<BasePriceDataImpl> CSVTabDataImpl::clone() {
@@ -507,103 +958,239 @@ namespace backtradercpp {
 
         inline void CSVTabDataImpl::init() {
 
-            raw_data_file_ = std::ifstream(raw_data_file_name_);
-            adj_data_file_ = std::ifstream(adj_data_file_name_);
+            raw_data_file_.open(raw_data_file_name_);
+            raw_data_file_.select_columns({});
+            if (separate_adj_()) {
+                adj_data_file_.open(adj_data_file_name_);
+                adj_data_file_.select_columns({});
+                adj_data_file_.read_row();
+            }
+            parse_errors_.clear();
 
-            // Read header
-            std::string header;
-            std::getline(raw_data_file_, header);
-            std::getline(adj_data_file_, header);
+            // Read header and detect assets.
+            raw_data_file_.read_row();
+            const auto& header = raw_data_file_.row();
 
-            // Read one line and detect assets.
-            auto row_string = CSVRowParaser::parse_row(header);
-            assets_ = row_string.size() - 1;
+            // Set codes.
+            codes_.clear();
+            std::vector<int> cols{ 0 };
+            for (std::size_t i = 1; i < header.size(); ++i) {
+                std::string code(header[i]);
+                if (code_filter_ == nullptr || code_filter_(code)) {
+                    codes_.emplace_back(std::move(code));
+                    cols.push_back(static_cast<int>(i));
+                }
+            }
+            assets_ = codes_.size();
             next_.resize(assets_);
 
-            // Set codes.
-            for (int i = 1; i < row_string.size(); ++i) {
-                codes_.emplace_back(std::move(row_string[i]));
+            // Skip other columns. Selected fields are time and assets in order.
+            if (code_filter_ != nullptr) {
+                raw_data_file_.select_columns(cols);
+                if (separate_adj_()) {
+                    adj_data_file_.select_columns(cols);
+                }
             }
 
             BasePriceDataImpl::init();
         }
 
-        inline void CSVTabDataImpl::cast_ohlc_data_(std::vector<std::string>& row_string, OHLCData& dest) {
+        inline void CSVTabDataImpl::cast_ohlc_data_(const CSVReader& reader, OHLCData& dest) {
             for (int i = 0; i < assets_; ++i) {
                 // dest.open.coeffRef(i) = std::numeric_limits<double>::quiet_NaN();
-                dest.open.coeffRef(i) = 0;
-                auto& s = row_string[i + 1];
-                try {
-                    boost::algorithm::trim(s);
-                    dest.open.coeffRef(i) = boost::lexical_cast<double>(s);
-                }
-                catch (...) {
-                    util::cout("Bad cast: {}\n", s);
-                }
+                dest.open.coeffRef(i) = parse_cell_(reader, i + 1, 0);
             }
             dest.high = dest.low = dest.close = dest.open;
         };
 
         inline bool CSVTabDataImpl::read() {
-            std::getline(raw_data_file_, next_row_);
-            if (raw_data_file_.eof()) {
+            if (preload_ && panel_ == nullptr) {
+                load_panel_();
+            }
+            if (panel_ != nullptr) {
+                return read_panel_();
+            }
+            if (!raw_data_file_.read_row() || raw_data_file_.row().empty()) {
                 finished_ = true;
                 return false;
             }
-            auto row_string = CSVRowParaser::parse_row(next_row_);
-            next_.time = boost::posix_time::time_from_string(time_converter_(row_string[0]));
-            cast_ohlc_data_(row_string, next_.data);
+            const auto& row = raw_data_file_.row();
+            next_.time = time_converter_.parse(row[0]);
+            cast_ohlc_data_(raw_data_file_, next_.data);
 
-            std::getline(adj_data_file_, adj_next_row_);
-            row_string = CSVRowParaser::parse_row(adj_next_row_);
-            cast_ohlc_data_(row_string, next_.adj_data);
+            if (separate_adj_()) {
+                adj_data_file_.read_row();
+                cast_ohlc_data_(adj_data_file_, next_.adj_data);
+            }
+            else {
+                next_.adj_data.open = next_.data.open;
+                next_.adj_data.high = next_.adj_data.low = next_.adj_data.close = next_.adj_data.open;
+                apply_adj_factors_();
+            }
 
             // Set volume to very large.
-            next_.volume.setConstant(1e12);
+            next_.volume.setConstant(std::numeric_limits<int>::max());
             next_.validate_assets();
 
             return true;
         }
 
-        template <typename DataT, typename FeedT, typename BufferT>
-        inline bool GenericFeedsAggragator<DataT, FeedT, BufferT>::read() {
-            bool all_finished = true;
-            for (int i = 0; i < feeds_.size(); ++i) {
-                if (status_[i] == Invalid) {
-                    bool _get = feeds_[i].read();
-                    if (_get) {
-                        times_[i] = feeds_[i].time();
-                        status_[i] = Valid;
-                        all_finished = false;
+        inline void CSVTabDataImpl::seek(const ptime& time, int history) {
+            finished_ = false;
+            rewind_adj_factors_();
+            if (preload_ && panel_ == nullptr) {
+                load_panel_();
+            }
+            if (panel_ != nullptr) {
+                panel_row_ = std::max(panel_->lower_bound(time) - history, 0);
+                return;
+            }
+            auto raw_index = TimeIndex::get(raw_data_file_name_, 0, time_converter_);
+            if (!separate_adj_()) {
+                raw_index.seek(raw_data_file_, raw_index.find(time, history));
+                return;
+            }
+            auto adj_index = TimeIndex::get(adj_data_file_name_, 0, time_converter_);
+            int k = raw_index.find(time, history);
+            if (!raw_index.aligned(adj_index, k)) {
+                k = -1;
+            }
+            raw_index.seek(raw_data_file_, k);
+            adj_index.seek(adj_data_file_, k);
+        }
+
+        inline void CSVTabDataImpl::load_panel_() {
+            auto stamp = [](const std::string& file) {
+                auto s = util::file_stamp(file);
+                return fmt::format("{}|{}|{}", file, s.size, s.mtime);
+            };
+            // Without adjusted file, panel has raw prices only and factors are applied on read.
+            bool separate = separate_adj_();
+            std::string key = fmt::format("tab\ntime: {}\ncodes: {}\n{}\n{}\n",
+                time_converter_.process_key(), fmt::join(codes_, ","), stamp(raw_data_file_name_),
+                separate ? stamp(adj_data_file_name_) : "no adj");
+            panel_ = DatasetStore::get(key, [&] {
+                parse_errors_.clear();
+                std::vector<ptime> times;
+                std::vector<double> raw, adj;
+                raw_data_file_.rewind();
+                raw_data_file_.read_row();
+                if (separate) {
+                    adj_data_file_.rewind();
+                    adj_data_file_.read_row();
+                }
+                while (raw_data_file_.read_row() && !raw_data_file_.row().empty()) {
+                    times.emplace_back(time_converter_.parse(raw_data_file_.row()[0]));
+                    if (separate) {
+                        adj_data_file_.read_row();
                     }
-                    else {
-                        status_[i] = Finished;
-                        times_[i] = boost::posix_time::max_date_time;
+                    for (int i = 0; i < assets_; ++i) {
+                        raw.emplace_back(parse_cell_(raw_data_file_, i + 1, 0));
+                        if (separate) {
+                            adj.emplace_back(parse_cell_(adj_data_file_, i + 1, 0));
+                        }
                     }
                 }
+                auto panel = PricePanel::build_tabular(times, assets_, raw, adj);
+                panel->set_parse_errors(parse_errors_);
+                return std::shared_ptr<const PricePanel>(panel);
+            });
+            parse_errors_ = panel_->parse_errors();
+            panel_row_ = 0;
+        }
+
+        inline bool CSVTabDataImpl::read_panel_() {
+            if (panel_row_ >= panel_->rows()) {
+                finished_ = true;
+                return false;
+            }
+            int r = panel_row_++;
+            auto row = [&](int field) {
+                return Eigen::Map<const VecArrXd>(panel_->row(field, r), assets_);
+            };
+            next_.time = panel_->time(r);
+            next_.data.open = row(PricePanel::Close);
+            next_.data.high = next_.data.low = next_.data.close = next_.data.open;
+            next_.adj_data.open = row(PricePanel::AdjClose);
+            next_.adj_data.high = next_.adj_data.low = next_.adj_data.close = next_.adj_data.open;
+            apply_adj_factors_();
+
+            next_.volume.setConstant(std::numeric_limits<int>::max());
+            next_.validate_assets();
+            return true;
+        }
+
+        template <typename DataT, typename FeedT, typename BufferT>
+        inline bool GenericFeedsAggragator<DataT, FeedT, BufferT>::next_time_(ptime& time,
+            VecArrXb& valid) {
+            for (int i : to_read_) {
+                if (feeds_[i].read()) {
+                    queue_.emplace(feeds_[i].time(), i);
+                }
             }
+            to_read_.clear();
 
-            if (all_finished) {
+            if (queue_.empty()) {
                 return false;
             }
 
             // Use minimum date as the next date.
-            auto p = std::min_element(times_.begin(), times_.end());
-            time_ = *p;
+            time = queue_.top().first;
+            valid.setConstant(feeds_.size(), false);
+            while (!queue_.empty() && queue_.top().first == time) {
+                int i = queue_.top().second;
+                queue_.pop();
+                valid.coeffRef(i) = true;
+                to_read_.push_back(i);
+            }
+            return true;
+        }
+
+        template <typename DataT, typename FeedT, typename BufferT>
+        inline bool GenericFeedsAggragator<DataT, FeedT, BufferT>::read() {
+            if (!next_time_(time_, datas_valid_)) {
+                finished_ = true;
+                return false;
+            }
             for (int i = 0; i < feeds_.size(); ++i) {
-                if (times_[i] == time_) {
+                if (datas_valid_.coeff(i)) {
                     data_[i].push_back(feeds_[i].sp->next());
-                    status_[i] = Invalid;
-                    datas_valid_[i] = true;
                 }
                 else {
                     data_[i].push_back_();
-                    datas_valid_[i] = false;
                 }
             }
-            bool success = datas_valid_.any();
-            finished_ = !success;
-            return success;
+            return true;
+        }
+
+        template <typename DataT, typename FeedT, typename BufferT>
+        inline bool GenericFeedsAggragator<DataT, FeedT, BufferT>::fetch(Bar& bar) {
+            bar.ok = next_time_(bar.time, bar.valid);
+            if (bar.ok) {
+                bar.data.resize(feeds_.size());
+                for (std::size_t i = 0; i < feeds_.size(); ++i) {
+                    bar.data[i] = feeds_[i].sp->next();
+                }
+            }
+            return bar.ok;
+        }
+
+        template <typename DataT, typename FeedT, typename BufferT>
+        inline void GenericFeedsAggragator<DataT, FeedT, BufferT>::commit(const Bar& bar) {
+            if (!bar.ok) {
+                finished_ = true;
+                return;
+            }
+            time_ = bar.time;
+            datas_valid_ = bar.valid;
+            for (std::size_t i = 0; i < feeds_.size(); ++i) {
+                if (datas_valid_.coeff(i)) {
+                    data_[i].push_back(bar.data[i]);
+                }
+                else {
+                    data_[i].push_back_();
+                }
+            }
         }
         // inline const std::vector<FullAssetData> &FeedsAggragator::get_and_read() {
         //     read();
@@ -611,8 +1198,7 @@ namespace backtradercpp {
         // }
         template <typename DataT, typename FeedT, typename BufferT>
         inline void GenericFeedsAggragator<DataT, FeedT, BufferT>::add_feed(const FeedT& feed) {
-            status_.emplace_back(Invalid);
-            times_.emplace_back();
+            to_read_.push_back(feeds_.size());
 
             feeds_.push_back(feed);
             next_.push_back(&(feed.sp->next()));
@@ -631,19 +1217,45 @@ namespace backtradercpp {
         }
 
         template <typename DataT, typename FeedT, typename BufferT>
-        void GenericFeedsAggragator<DataT, FeedT, BufferT>::reset() {
-            for (auto& ele : status_) {
-                ele = Invalid;
+        void GenericFeedsAggragator<DataT, FeedT, BufferT>::seek(const ptime& time, int history) {
+            queue_ = {};
+            to_read_.resize(feeds_.size());
+            std::iota(to_read_.begin(), to_read_.end(), 0);
+            finished_ = false;
+            for (auto& f : feeds_) {
+                f.seek(time, history);
             }
+        }
+
+        template <typename DataT, typename FeedT, typename BufferT>
+        int GenericFeedsAggragator<DataT, FeedT, BufferT>::max_window() const {
+            int res = 0;
+            for (const auto& d : data_) {
+                res = std::max(res, d.window());
+            }
+            return res;
+        }
+
+        template <typename DataT, typename FeedT, typename BufferT>
+        void GenericFeedsAggragator<DataT, FeedT, BufferT>::reset() {
+            queue_ = {};
+            to_read_.resize(feeds_.size());
+            std::iota(to_read_.begin(), to_read_.end(), 0);
             time_ = boost::gregorian::min_date_time;
             finished_ = false;
             for (auto& f : feeds_) {
                 f.reset();
             }
+            // Bars of last run are not history of next one, e.g. for derived fields of first bar.
+            for (auto& d : data_) {
+                for (int k = 0; k < d.window(); ++k) {
+                    d.push_back_();
+                }
+            }
         }
 
         inline CSVDirDataImpl::CSVDirDataImpl(const std::string& raw_data_dir, std::array<int, 5> tohlc_map,
-            TimeStrConv::func_type time_converter)
+            TimeParser time_converter)
             : BasePriceDataImpl(time_converter), raw_data_dir(raw_data_dir), adj_data_dir(raw_data_dir),
             tohlc_map(tohlc_map) {
             init();
@@ -651,7 +1263,7 @@ namespace backtradercpp {
 
         inline CSVDirDataImpl::CSVDirDataImpl(const std::string& raw_data_dir,
             const std::string& adj_data_dir, std::array<int, 5> tohlc_map,
-            TimeStrConv::func_type time_converter)
+            TimeParser time_converter)
             : BasePriceDataImpl(time_converter), raw_data_dir(raw_data_dir), adj_data_dir(adj_data_dir),
             tohlc_map(tohlc_map) {
             init();
@@ -660,13 +1272,32 @@ namespace backtradercpp {
         CSVDirDataImpl::CSVDirDataImpl(const CSVDirDataImpl& impl_) : BasePriceDataImpl(impl_) {
             raw_data_dir = impl_.raw_data_dir;
             adj_data_dir = impl_.adj_data_dir;
+            tohlc_map = impl_.tohlc_map;
+            extra_num_col_ = impl_.extra_num_col_;
+            extra_str_col_ = impl_.extra_str_col_;
+            extra_num_col_names_ = impl_.extra_num_col_names_;
+            extra_str_col_names_ = impl_.extra_str_col_names_;
+            code_extractor_ = impl_.code_extractor_;
+            cache_file_ = impl_.cache_file_;
+            preload_ = impl_.preload_;
+            max_open_files_ = impl_.max_open_files_;
+            block_size_ = impl_.block_size_;
+            panel_ = impl_.panel_;
             init();
+            init_extra_cols_();
+            adj_factors(impl_.adj_factors_);
         }
 
         inline void CSVDirDataImpl::init() {
             print(fg(fmt::color::yellow), "Reading asset pricing data in directory {}\n", raw_data_dir);
+            assets_ = 0;
             codes_.clear();
+            raw_data_filenames.clear();
+            adj_data_filenames.clear();
             for (const auto& entry : std::filesystem::directory_iterator(raw_data_dir)) {
+                if (entry.path().extension() == TimeIndex::extension) {
+                    continue;
+                }
                 auto file_path = entry.path().filename();
                 auto adj_file_path = std::filesystem::path(adj_data_dir) / file_path;
                 if (!exists(adj_file_path)) {
@@ -674,149 +1305,389 @@ namespace backtradercpp {
                         adj_file_path.string(), file_path.string());
                 }
                 else {
-                    raw_files.emplace_back(entry.path());
-                    adj_files.emplace_back(adj_file_path);
-
                     raw_data_filenames.emplace_back(entry.path().string());
                     adj_data_filenames.emplace_back(adj_file_path.string());
 
                     ++assets_;
-                    codes_.emplace_back(file_path.string());
+                    // x.csv.gz has the same code as x.csv.
+                    codes_.emplace_back(util::CompressedStream::codec_of(file_path.string()) ==
+                        util::CompressedStream::Codec::None
+                        ? file_path.string()
+                        : file_path.stem().string());
+                }
+            }
+            if (code_extractor_) {
+                for (auto& ele : codes_) {
+                    ele = code_extractor_(ele);
                 }
             }
 
             next_.resize(assets_);
-            times.resize(assets_);
-            status.resize(assets_, Invalid);
-            raw_line_buffer.resize(assets_);
-            adj_line_buffer.resize(assets_);
-            raw_parsed_buffer.resize(assets_);
-            adj_parsed_buffer.resize(assets_);
             raw_parsed_double_buffer.resize(assets_);
             adj_parsed_double_buffer.resize(assets_);
 
+            // Files are opened on first read, as they are not needed if a cache file is used.
+            raw_files.clear();
+            adj_files.clear();
+            files_opened_ = false;
+
+            // init_extra_data();
+
+            BasePriceDataImpl::init();
+        }
+
+        inline void CSVDirDataImpl::open_files_() {
+            bool separate = separate_adj_();
+            raw_files.resize(assets_);
+            adj_files.resize(separate ? assets_ : 0);
+            parse_errors_.clear();
+            file_pool_ = max_open_files_ > 0 ? std::make_shared<util::FilePool>(max_open_files_) : nullptr;
+
             // Read header.
 #pragma omp parallel for
             for (int i = 0; i < assets_; ++i) {
-                std::getline(raw_files[i], raw_line_buffer[i]);
-                std::getline(adj_files[i], adj_line_buffer[i]);
+                if (file_pool_ != nullptr) {
+                    raw_files[i].open(raw_data_filenames[i], *file_pool_, block_size_);
+                    if (separate) {
+                        adj_files[i].open(adj_data_filenames[i], *file_pool_, block_size_);
+                    }
+                }
+                else {
+                    raw_files[i].open(raw_data_filenames[i]);
+                    if (separate) {
+                        adj_files[i].open(adj_data_filenames[i]);
+                    }
+                }
+                raw_files[i].read_row();
+                if (separate) {
+                    adj_files[i].read_row();
+                }
+            }
+            fill_queue_();
+            files_opened_ = true;
+        }
+
+        inline void CSVDirDataImpl::fill_queue_() {
+            queue_ = {};
+            printed_.clear();
+            next_.reset();
+            for (int i = 0; i < assets_; ++i) {
+                advance_(i);
             }
+        }
 
-            // init_extra_data();
+        inline void CSVDirDataImpl::seek(const ptime& time, int history) {
+            rewind_adj_factors_();
+            if ((preload_ || !cache_file_.empty()) && panel_ == nullptr) {
+                load_panel_();
+            }
+            if (panel_ != nullptr) {
+                panel_row_ = std::max(panel_->lower_bound(time) - history, 0);
+                return;
+            }
+            if (!files_opened_) {
+                open_files_();
+            }
 
-            BasePriceDataImpl::init();
+#pragma omp parallel for schedule(dynamic)
+            for (int i = 0; i < assets_; ++i) {
+                TimeParser time_parser(time_converter_);
+                auto raw_index = TimeIndex::get(raw_data_filenames[i], tohlc_map[0], time_parser);
+                if (!separate_adj_()) {
+                    raw_index.seek(raw_files[i], raw_index.find(time, history));
+                    continue;
+                }
+                auto adj_index = TimeIndex::get(adj_data_filenames[i], tohlc_map[0], time_parser);
+                int k = raw_index.find(time, history);
+                if (!raw_index.aligned(adj_index, k)) {
+                    k = -1;
+                }
+                raw_index.seek(raw_files[i], k);
+                adj_index.seek(adj_files[i], k);
+            }
+            fill_queue_();
+        }
+
+        inline CSVDirDataImpl& CSVDirDataImpl::extra_num_col(
+            const std::vector<std::pair<int, std::string>>& cols) {
+            for (const auto& [col, name] : cols) {
+                extra_num_col_.push_back(col);
+                extra_num_col_names_.push_back(name);
+            }
+            init_extra_cols_();
+            return *this;
+        }
+
+        inline CSVDirDataImpl& CSVDirDataImpl::extra_str_col(
+            const std::vector<std::pair<int, std::string>>& cols) {
+            for (const auto& [col, name] : cols) {
+                extra_str_col_.push_back(col);
+                extra_str_col_names_.push_back(name);
+            }
+            init_extra_cols_();
+            return *this;
+        }
+
+        inline void CSVDirDataImpl::init_extra_cols_() {
+            auto schema = std::make_shared<FieldSchema>();
+            for (const auto& name : extra_num_col_names_) {
+                schema->add_num(name);
+            }
+            for (const auto& name : extra_str_col_names_) {
+                schema->add_str(name);
+            }
+            next_.schema = schema;
+            next_.num_data_.setZero(extra_num_col_.size(), assets_);
+            next_.str_data_.setZero(extra_str_col_.size(), assets_);
+            str_last_.setZero(extra_str_col_.size(), assets_);
+            panel_str_codes_.clear();
         }
 
-#define UNWRAP(...) __VA_ARGS__
-#define BK_CSVDirectoryDataImpl_extra_col(name, init)                                              \
-    inline CSVDirDataImpl &CSVDirDataImpl::extra_##name##_col(                                     \
-        const std::vector<std::pair<int, std::string>> &cols) {                                    \
-        for (const auto &col : cols) {                                                             \
-            extra_##name##_col_.emplace_back(col.first);                                           \
-                                                                                                   \
-            const auto &name_ = col.second;                                                        \
-            extra_##name##_col_names_.emplace_back(name_);                                         \
-            next_.name##_data_[name_] = init;                                                      \
-            std::cout << name_ << " size " << next_.name##_data_[name_].size() << std::endl;       \
-            extra_##name##_data_ref_.emplace_back(next_.name##_data_[name_]);                      \
-        }                                                                                          \
-        std::cout << extra_num_data_ref_[0].get().size() << std::endl;                             \
-        return *this;                                                                              \
-    }
-        BK_CSVDirectoryDataImpl_extra_col(num, UNWRAP(VecArrXd::Zero(assets_)));
-        BK_CSVDirectoryDataImpl_extra_col(str, UNWRAP(std::vector<std::string>(assets_)));
-#undef BK_CSVDirectoryDataImpl_extra_col
-#undef UNWRAP
+        inline int CSVDirDataImpl::str_code_(int j, int i, std::string_view s) {
+            // Values of an asset seldom change, so the dictionary is only searched on change.
+            int& last = str_last_(j, i);
+            auto& dict = *next_.schema->str_dicts[j];
+            if (dict.value(last) != s) {
+                last = dict.code(s);
+            }
+            return last;
+        }
 
         bool CSVDirDataImpl::read() {
+            if ((preload_ || !cache_file_.empty()) && panel_ == nullptr) {
+                load_panel_();
+            }
+            if (panel_ != nullptr) {
+                return read_panel_();
+            }
+            if (!files_opened_) {
+                open_files_();
+            }
 
-            next_.reset();
-            // read data.
-            for (int i = 0; i < assets_; ++i) {
-                switch (status[i]) {
-                case Finished:
-                    break;
-                case Invalid:
-                    // Try read data from file.
-                    if (!raw_files[i].eof()) {
-                        std::getline(raw_files[i], raw_line_buffer[i]);
-                        raw_parsed_buffer[i] = CSVRowParaser::parse_row(raw_line_buffer[i]);
-                        if (raw_parsed_buffer[i].empty()) {
-                            status[i] = Finished;
-                            break;
-                        }
-                        std::getline(adj_files[i], adj_line_buffer[i]);
-                        adj_parsed_buffer[i] = CSVRowParaser::parse_row(adj_line_buffer[i]);
-                        const auto& [t1, t2] = std::make_tuple(raw_parsed_buffer[i][tohlc_map[0]],
-                            adj_parsed_buffer[i][tohlc_map[0]]);
-                        if (t1 != t2) {
-                            print(fg(fmt::color::red),
-                                "data in raw data file {} and adjusted data file {} have different "
-                                "dates: {} "
-                                "and {}. Please check data. Now abort...\n",
-                                raw_data_filenames[i], adj_data_filenames[i], t1, t2);
-                            std::abort();
-                        }
-                        times[i] = boost::posix_time::time_from_string(time_converter_(t1));
+            if (queue_.empty()) {
+                return false;
+            }
+            // Only assets printed in last bar need to be cleared.
+            for (int i : printed_) {
+                next_.reset_asset(i);
+            }
+            printed_.clear();
+            next_.time = queue_.top().first;
+            while (!queue_.empty() && queue_.top().first == next_.time) {
+                printed_.push_back(queue_.top().second);
+                queue_.pop();
+            }
+
+            // Read data.
+            bool separate = separate_adj_();
+            int printed = static_cast<int>(printed_.size());
+#pragma omp parallel for
+            for (int k = 0; k < printed; ++k) {
+                int i = printed_[k];
+                const auto& raw_row = raw_files[i].row();
+                for (int j = 0; j < 4; ++j) {
+                    // Fill ohlc data.
+                    raw_parsed_double_buffer[i][j] = parse_cell_(raw_files[i], tohlc_map[j + 1]);
+                    adj_parsed_double_buffer[i][j] = separate
+                        ? parse_cell_(adj_files[i], tohlc_map[j + 1])
+                        : raw_parsed_double_buffer[i][j];
+                }
+                next_.data.open.coeffRef(i) = raw_parsed_double_buffer[i][0];
+                next_.data.high.coeffRef(i) = raw_parsed_double_buffer[i][1];
+                next_.data.low.coeffRef(i) = raw_parsed_double_buffer[i][2];
+                next_.data.close.coeffRef(i) = raw_parsed_double_buffer[i][3];
+
+                next_.adj_data.open.coeffRef(i) = adj_parsed_double_buffer[i][0];
+                next_.adj_data.high.coeffRef(i) = adj_parsed_double_buffer[i][1];
+                next_.adj_data.low.coeffRef(i) = adj_parsed_double_buffer[i][2];
+                next_.adj_data.close.coeffRef(i) = adj_parsed_double_buffer[i][3];
+
+                // Fill extra data
+                for (std::size_t j = 0; j < extra_num_col_.size(); ++j) {
+                    next_.num_data_(j, i) = parse_cell_(raw_files[i], extra_num_col_[j]);
+                }
+                for (std::size_t j = 0; j < extra_str_col_.size(); ++j) {
+                    next_.str_data_(j, i) = str_code_(j, i, raw_row[extra_str_col_[j]]);
+                }
+                next_.validate_asset(i);
+            }
+            apply_adj_factors_();
+
+            // Read next rows of printed assets. Rows are kept in readers until they are printed.
+            for (int i : printed_) {
+                advance_(i);
+            }
+            return true;
+        }
+
+        inline void CSVDirDataImpl::advance_(int i) {
+            auto& raw_file = raw_files[i];
+            if (!raw_file.read_row() || raw_file.row().empty()) {
+                return; // Finished.
+            }
+            if (!separate_adj_()) {
+                queue_.emplace(parse_time_(raw_file.row()[tohlc_map[0]]), i);
+                return;
+            }
+            auto& adj_file = adj_files[i];
+            adj_file.read_row();
+            const auto& [t1, t2] =
+                std::make_tuple(raw_file.row()[tohlc_map[0]], adj_file.row()[tohlc_map[0]]);
+            if (t1 != t2) {
+                print(fg(fmt::color::red),
+                    "data in raw data file {} and adjusted data file {} have different "
+                    "dates: {} "
+                    "and {}. Please check data. Now abort...\n",
+                    raw_data_filenames[i], adj_data_filenames[i], t1, t2);
+                std::abort();
+            }
+            queue_.emplace(parse_time_(t1), i);
+        }
 
-                        status[i] = Valid; // After reading data, set to valid.
+        inline AssetSeries CSVDirDataImpl::read_asset_series_(int i, const TimeParser& time_parser) {
+            AssetSeries s;
+            s.num.resize(extra_num_col_.size());
+            s.str.resize(extra_str_col_.size());
+
+            // Without adjusted files, adjusted series are left empty and panel shares raw prices.
+            bool separate = separate_adj_();
+            CSVReader raw_file(raw_data_filenames[i]), adj_file;
+            raw_file.read_row();
+            if (separate) {
+                adj_file.open(adj_data_filenames[i]);
+                adj_file.read_row();
+            }
+            while (raw_file.read_row()) {
+                const auto& raw_row = raw_file.row();
+                if (raw_row.empty()) {
+                    break;
+                }
+                const auto& t1 = raw_row[tohlc_map[0]];
+                if (separate) {
+                    adj_file.read_row();
+                    const auto& t2 = adj_file.row()[tohlc_map[0]];
+                    if (t1 != t2) {
+                        print(fg(fmt::color::red),
+                            "data in raw data file {} and adjusted data file {} have different "
+                            "dates: {} "
+                            "and {}. Please check data. Now abort...\n",
+                            raw_data_filenames[i], adj_data_filenames[i], t1, t2);
+                        std::abort();
                     }
-                    else {
-                        status[i] = Finished;
+                }
+                s.times.emplace_back(time_parser.parse(t1));
+                for (int j = 0; j < 4; ++j) {
+                    s.ohlc[j].emplace_back(parse_cell_(raw_file, tohlc_map[j + 1]));
+                    if (separate) {
+                        s.ohlc[j + 4].emplace_back(parse_cell_(adj_file, tohlc_map[j + 1]));
                     }
-                    break;
-                case Valid:
-                    break;
-                default:
-                    break;
+                }
+                for (std::size_t j = 0; j < extra_num_col_.size(); ++j) {
+                    s.num[j].emplace_back(parse_cell_(raw_file, extra_num_col_[j]));
+                }
+                for (std::size_t j = 0; j < extra_str_col_.size(); ++j) {
+                    s.str[j].emplace_back(raw_row[extra_str_col_[j]]);
+                }
+            }
+            return s;
+        }
+
+        // Everything that affects content of the cache file.
+        inline std::string CSVDirDataImpl::cache_manifest_() const {
+            std::string res = fmt::format("time: {}\ntohlc: {}\nnum: {} {}\nstr: {} {}\n",
+                time_converter_.key(), fmt::join(tohlc_map, ","),
+                fmt::join(extra_num_col_, ","), fmt::join(extra_num_col_names_, ","),
+                fmt::join(extra_str_col_, ","), fmt::join(extra_str_col_names_, ","));
+            // Without adjusted files, cache has raw prices only and factors are applied on read.
+            bool separate = separate_adj_();
+            res += separate ? "adj: files\n" : "adj: none\n";
+            auto add_stamp = [&](const std::string& file) {
+                auto stamp = util::file_stamp(file);
+                res += fmt::format("{}|{}|{}\n", file, stamp.size, stamp.mtime);
+            };
+            for (int i = 0; i < assets_; ++i) {
+                add_stamp(raw_data_filenames[i]);
+                if (separate) {
+                    add_stamp(adj_data_filenames[i]);
                 }
             }
-            if (std::ranges::all_of(status, [](const auto& e) { return e == Finished; })) {
+            return res;
+        }
+
+        inline void CSVDirDataImpl::load_panel_() {
+            std::string manifest = cache_manifest_();
+            std::string key = fmt::format("dir\n{}\n{}", time_converter_.process_key(), manifest);
+            panel_ = DatasetStore::get(key, [&] {
+                std::shared_ptr<PricePanel> panel = nullptr;
+                if (!cache_file_.empty()) {
+                    panel = PricePanel::load(cache_file_, manifest);
+                }
+                if (panel == nullptr) {
+                    if (!cache_file_.empty()) {
+                        print(fg(fmt::color::yellow), "Building cache file {}.\n", cache_file_);
+                    }
+                    parse_errors_.clear();
+                    std::vector<AssetSeries> series(assets_);
+                    // Files have quite different sizes.
+#pragma omp parallel for schedule(dynamic)
+                    for (int i = 0; i < assets_; ++i) {
+                        series[i] = read_asset_series_(i, TimeParser(time_converter_));
+                    }
+                    panel = PricePanel::build(series, extra_num_col_.size(), extra_str_col_.size());
+                    panel->set_parse_errors(parse_errors_);
+                    if (!cache_file_.empty()) {
+                        panel->save(cache_file_, manifest);
+                    }
+                }
+                else {
+                    print(fg(fmt::color::yellow), "Using cache file {}.\n", cache_file_);
+                }
+                return std::shared_ptr<const PricePanel>(panel);
+            });
+            parse_errors_ = panel_->parse_errors();
+            panel_row_ = 0;
+        }
+
+        inline bool CSVDirDataImpl::read_panel_() {
+            if (panel_row_ >= panel_->rows()) {
                 return false;
             }
-            // Find smallest time.
-            auto it = std::ranges::min_element(times);
-            if (it != times.end()) {
-                next_.time = *it;
-                // Read data.
-#pragma omp parallel for
-                for (int i = 0; i < assets_; ++i) {
-                    if ((status[i] == Valid) && (times[i] == *it)) {
-                        for (int j = 0; j < 4; ++j) {
-                            // Fill ohlc data.
-                            raw_parsed_double_buffer[i][j] =
-                                CSVRowParaser::parse_double(raw_parsed_buffer[i][tohlc_map[j + 1]]);
-                            adj_parsed_double_buffer[i][j] =
-                                CSVRowParaser::parse_double(adj_parsed_buffer[i][tohlc_map[j + 1]]);
-                        }
-                        next_.data.open.coeffRef(i) = raw_parsed_double_buffer[i][0];
-                        next_.data.high.coeffRef(i) = raw_parsed_double_buffer[i][1];
-                        next_.data.low.coeffRef(i) = raw_parsed_double_buffer[i][2];
-                        next_.data.close.coeffRef(i) = raw_parsed_double_buffer[i][3];
-
-                        next_.adj_data.open.coeffRef(i) = adj_parsed_double_buffer[i][0];
-                        next_.adj_data.high.coeffRef(i) = adj_parsed_double_buffer[i][1];
-                        next_.adj_data.low.coeffRef(i) = adj_parsed_double_buffer[i][2];
-                        next_.adj_data.close.coeffRef(i) = adj_parsed_double_buffer[i][3];
-
-                        // Fill extra data
-                        for (int j = 0; j < extra_num_col_.size(); ++j) {
-                            extra_num_data_ref_[j].get().coeffRef(i) =
-                                CSVRowParaser::parse_double(raw_parsed_buffer[i][extra_num_col_[j]]);
-                        }
-                        for (int j = 0; j < extra_str_col_.size(); ++j) {
-                            extra_str_data_ref_[j].get()[i] = raw_parsed_buffer[i][extra_str_col_[j]];
-                        }
+            const auto& p = *panel_;
+            int r = panel_row_++;
+            auto row = [&](int field) { return Eigen::Map<const VecArrXd>(p.row(field, r), assets_); };
 
-                        status[i] = Invalid; // After read data, set to invalid.
+            next_.reset();
+            next_.time = p.time(r);
+            next_.data.open = row(PricePanel::Open);
+            next_.data.high = row(PricePanel::High);
+            next_.data.low = row(PricePanel::Low);
+            next_.data.close = row(PricePanel::Close);
+            next_.adj_data.open = row(PricePanel::AdjOpen);
+            next_.adj_data.high = row(PricePanel::AdjHigh);
+            next_.adj_data.low = row(PricePanel::AdjLow);
+            next_.adj_data.close = row(PricePanel::AdjClose);
+            apply_adj_factors_();
+            for (std::size_t j = 0; j < extra_num_col_.size(); ++j) {
+                next_.num_data_.row(j) = row(PricePanel::OHLCFields + j).transpose();
+            }
+            if (panel_str_codes_.empty()) {
+                panel_str_codes_.resize(extra_str_col_.size());
+                for (std::size_t j = 0; j < extra_str_col_.size(); ++j) {
+                    auto& dict = *next_.schema->str_dicts[j];
+                    for (int c = 0; c < p.str_dict_size(j); ++c) {
+                        panel_str_codes_[j].push_back(dict.code(p.str_value(j, c)));
                     }
                 }
-                next_.validate_assets();
-                return true;
             }
-            else {
-                return false;
+            for (std::size_t j = 0; j < extra_str_col_.size(); ++j) {
+                const int32_t* codes = p.str_row(j, r);
+                const auto& map = panel_str_codes_[j];
+                for (int i = 0; i < assets_; ++i) {
+                    next_.str_data_(j, i) = map[codes[i]];
+                }
             }
+            next_.validate_assets();
+            return true;
         }
 
         std::shared_ptr<BasePriceDataImpl> CSVDirDataImpl::clone() {
@@ -826,12 +1697,439 @@ namespace backtradercpp {
             res->extra_str_col_ = extra_str_col_;
             res->extra_num_col_names_ = extra_num_col_names_;
             res->extra_str_col_names_ = extra_str_col_names_;
+            res->init_extra_cols_();
+            if (code_extractor_) {
+                res->code_extractor(code_extractor_);
+            }
+            res->cache_file_ = cache_file_;
+            res->preload_ = preload_;
+            res->max_open_files_ = max_open_files_;
+            res->block_size_ = block_size_;
+            res->panel_ = panel_;
+            res->adj_factors(adj_factors_);
+
+            return res;
+        }
+
+        inline AsOfJoinDataImpl::AsOfJoinDataImpl(std::shared_ptr<BasePriceDataImpl> base)
+            : BasePriceDataImpl(base->assets()), base_(std::move(base)) {
+            codes_ = base_->codes();
+            name_ = base_->name();
+        }
+
+        inline AsOfJoinDataImpl::AsOfJoinDataImpl(const AsOfJoinDataImpl& impl_)
+            : BasePriceDataImpl(impl_), base_(impl_.base_->clone()), sources_(impl_.sources_),
+            fields_(impl_.fields_), assets_mapped_(impl_.assets_mapped_) {
+            rewind_();
+        }
+
+        inline std::shared_ptr<BasePriceDataImpl> AsOfJoinDataImpl::clone() {
+            return std::make_shared<AsOfJoinDataImpl>(*this);
+        }
+
+        inline AsOfJoinDataImpl& AsOfJoinDataImpl::join(std::shared_ptr<const EventTable> events) {
+            Source source;
+            source.events = std::move(events);
+            for (const auto& name : source.events->fields()) {
+                auto it = std::find(fields_.begin(), fields_.end(), name);
+                source.fields.push_back(static_cast<int>(it - fields_.begin()));
+                if (it == fields_.end()) {
+                    fields_.push_back(name);
+                }
+            }
+            sources_.push_back(std::move(source));
+            assets_mapped_ = false;
+            schema_init_ = false;
+            return *this;
+        }
+
+        inline void AsOfJoinDataImpl::map_assets_() {
+            codes_ = base_->codes();
+            std::unordered_map<std::string, int> asset_index;
+            for (int i = 0; i < static_cast<int>(codes_.size()); ++i) {
+                asset_index.emplace(codes_[i], i);
+            }
+            for (auto& s : sources_) {
+                s.assets.clear();
+                for (const auto& code : s.events->codes()) {
+                    auto it = asset_index.find(code);
+                    s.assets.push_back(it == asset_index.end() ? -1 : it->second);
+                }
+            }
+            assets_mapped_ = true;
+        }
+
+        inline void AsOfJoinDataImpl::init_schema_(
+            const std::shared_ptr<const FieldSchema>& base_schema) {
+            auto schema = base_schema == nullptr ? std::make_shared<FieldSchema>()
+                : std::make_shared<FieldSchema>(*base_schema);
+            base_num_ = static_cast<int>(schema->num_names.size());
+            for (const auto& name : fields_) {
+                if (schema->num_index.contains(name) || schema->str_index.contains(name)) {
+                    throw std::invalid_argument("Column " + name + " of events is already in data.");
+                }
+                schema->add_num(name);
+            }
+            // Keep latest values, base columns may change in size only.
+            RowArrayXd latest = schema_init_ && next_.num_data_.rows() >= static_cast<Eigen::Index>(fields_.size())
+                ? next_.num_data_.bottomRows(fields_.size()).eval()
+                : RowArrayXd::Constant(fields_.size(), assets_,
+                    std::numeric_limits<double>::quiet_NaN());
+            next_.num_data_.resize(base_num_ + fields_.size(), assets_);
+            next_.num_data_.bottomRows(fields_.size()) = latest;
+
+            next_.schema = std::move(schema);
+            base_schema_ = base_schema;
+            schema_init_ = true;
+        }
+
+        inline void AsOfJoinDataImpl::rewind_() {
+            for (auto& s : sources_) {
+                s.next = 0;
+            }
+            if (schema_init_) {
+                next_.num_data_.bottomRows(fields_.size()).setConstant(
+                    std::numeric_limits<double>::quiet_NaN());
+            }
+        }
+
+        inline void AsOfJoinDataImpl::reset() {
+            BasePriceDataImpl::reset();
+            base_->reset();
+            rewind_();
+        }
+
+        inline void AsOfJoinDataImpl::seek(const ptime& time, int history) {
+            finished_ = false;
+            base_->seek(time, history);
+            // Events before the first bar are applied by the first read.
+            rewind_();
+        }
+
+        inline bool AsOfJoinDataImpl::read() {
+            if (!base_->read()) {
+                finished_ = true;
+                return false;
+            }
+            const auto& bar = base_->data();
+            if (!assets_mapped_) {
+                map_assets_();
+            }
+            if (!schema_init_ || bar.schema != base_schema_) {
+                init_schema_(bar.schema);
+            }
+
+            next_.time = bar.time;
+            next_.data = bar.data;
+            next_.adj_data = bar.adj_data;
+            next_.volume = bar.volume;
+            next_.valid = bar.valid;
+            next_.str_data_ = bar.str_data_;
+            if (base_num_ > 0) {
+                next_.num_data_.topRows(base_num_) = bar.num_data_;
+            }
+
+            int64_t time = util::to_epoch_us(bar.time);
+            for (auto& s : sources_) {
+                const auto& e = *s.events;
+                for (; s.next < e.size() && e.time(s.next) <= time; ++s.next) {
+                    int asset = s.assets[e.asset(s.next)];
+                    if (asset >= 0) {
+                        next_.num_data_(base_num_ + s.fields[e.field(s.next)], asset) = e.value(s.next);
+                    }
+                }
+            }
+            return true;
+        }
+
+        inline BarPeriod BarPeriod::make_(Unit unit, int n) {
+            if (n < 1) {
+                throw std::invalid_argument("Bar period must be at least 1, got " + std::to_string(n) + ".");
+            }
+            BarPeriod res;
+            res.unit = unit;
+            res.n = n;
+            return res;
+        }
+
+        inline int64_t BarPeriod::micros_() const {
+            return int64_t(n) * (unit == Minute ? 60 : 3600) * 1'000'000;
+        }
+
+        inline int64_t BarPeriod::key(const ptime& t) const {
+            // Floor division, times may be before 1970.
+            auto floor_div = [](int64_t a, int64_t b) { return a / b - (a % b < 0 ? 1 : 0); };
+            static const date epoch(1970, 1, 1);
+            switch (unit) {
+            case Minute:
+            case Hour:
+                return floor_div(util::to_epoch_us(t), micros_());
+            case Day:
+                return floor_div((t.date() - epoch).days(), n);
+            case Week:
+                return floor_div((t.date() - epoch).days() + 3, 7 * n); // 1970-01-01 is Thursday.
+            default:
+                return floor_div(int64_t(t.date().year()) * 12 + t.date().month() - 1, n);
+            }
+        }
+
+        inline ptime BarPeriod::start(int64_t key) const {
+            static const date epoch(1970, 1, 1);
+            switch (unit) {
+            case Minute:
+            case Hour:
+                return util::from_epoch_us(key * micros_());
+            case Day:
+                return ptime(epoch + boost::gregorian::days(key * n));
+            case Week:
+                return ptime(epoch + boost::gregorian::days(key * 7 * n - 3));
+            default: {
+                int64_t month = key * n;
+                return ptime(date(static_cast<int>(month / 12), static_cast<int>(month % 12) + 1, 1));
+            }
+            }
+        }
+
+        inline ResampledDataImpl::ResampledDataImpl(std::shared_ptr<BasePriceDataImpl> base,
+            BarPeriod period)
+            : BasePriceDataImpl(base->assets()), base_(std::move(base)), period_(period) {
+            codes_ = base_->codes();
+            name_ = base_->name();
+        }
+
+        inline ResampledDataImpl::ResampledDataImpl(const ResampledDataImpl& impl_)
+            : BasePriceDataImpl(impl_), base_(impl_.base_->clone()), period_(impl_.period_),
+            codes_synced_(impl_.codes_synced_) {}
+
+        inline std::shared_ptr<BasePriceDataImpl> ResampledDataImpl::clone() {
+            return std::make_shared<ResampledDataImpl>(*this);
+        }
+
+        inline void ResampledDataImpl::reset() {
+            BasePriceDataImpl::reset();
+            base_->reset();
+            pending_ = false;
+        }
+
+        inline void ResampledDataImpl::seek(const ptime& time, int history) {
+            finished_ = false;
+            pending_ = false;
+            // Whole periods are read, so the first bar is complete.
+            base_->seek(period_.start(period_.key(time) - history), 0);
+        }
+
+        inline bool ResampledDataImpl::read() {
+            if (!pending_ && !base_->read()) {
+                finished_ = true;
+                return false;
+            }
+            if (!codes_synced_) {
+                codes_ = base_->codes();
+                codes_synced_ = true;
+            }
+            start_(base_->data());
+            int64_t key = period_.key(next_.time);
+            while ((pending_ = base_->read())) {
+                const auto& bar = base_->data();
+                if (period_.key(bar.time) != key) {
+                    break;
+                }
+                merge_(bar);
+            }
+            return true;
+        }
+
+        inline void ResampledDataImpl::start_(const PriceFeedData& bar) {
+            next_.time = bar.time;
+            next_.data = bar.data;
+            next_.adj_data = bar.adj_data;
+            next_.volume = bar.volume;
+            next_.valid = bar.valid;
+            next_.schema = bar.schema;
+            next_.num_data_ = bar.num_data_;
+            next_.str_data_ = bar.str_data_;
+            seen_ = bar.valid;
+        }
+
+        inline void ResampledDataImpl::merge_(const PriceFeedData& bar) {
+            next_.time = bar.time;
+            // Assets not seen take the bar as is, seen assets take valid bars only.
+            VecArrXb fresh = !seen_;
+            VecArrXb add = seen_ && bar.valid;
+            VecArrXb latest = fresh || bar.valid;
+            auto merge_ohlc = [&](OHLCData& res, const OHLCData& b) {
+                res.open = fresh.select(b.open, res.open);
+                res.high = fresh.select(b.high, add.select(res.high.max(b.high), res.high));
+                res.low = fresh.select(b.low, add.select(res.low.min(b.low), res.low));
+                res.close = latest.select(b.close, res.close);
+            };
+            merge_ohlc(next_.data, bar.data);
+            merge_ohlc(next_.adj_data, bar.adj_data);
+
+            // Saturate, as volume may be implicitly very large, see CSVTabDataImpl. Sum of two ints
+            // is exact in double.
+            VecArrXi volume = (next_.volume.cast<double>() + bar.volume.cast<double>())
+                .min(double(std::numeric_limits<int>::max()))
+                .cast<int>();
+            next_.volume = fresh.select(bar.volume, add.select(volume, next_.volume));
+            next_.valid = seen_ || bar.valid;
+
+            if (bar.schema != next_.schema || bar.num_data_.rows() != next_.num_data_.rows() ||
+                bar.str_data_.rows() != next_.str_data_.rows()) {
+                // Columns are added, keep values of bar.
+                next_.schema = bar.schema;
+                next_.num_data_ = bar.num_data_;
+                next_.str_data_ = bar.str_data_;
+            }
+            else if (next_.num_data_.rows() > 0 || next_.str_data_.rows() > 0) {
+                for (int i = 0; i < assets_; ++i) {
+                    if (latest.coeff(i)) {
+                        next_.num_data_.col(i) = bar.num_data_.col(i);
+                        next_.str_data_.col(i) = bar.str_data_.col(i);
+                    }
+                }
+            }
+            seen_ = next_.valid;
+        }
+
+        inline TickDataImpl::TickDataImpl(const std::string& file, BarPeriod period)
+            : period_(period) {
+            init_(file);
+        }
+
+        inline TickDataImpl::TickDataImpl(const std::string& file, int64_t bar_volume)
+            : bar_volume_(bar_volume) {
+            if (bar_volume <= 0) {
+                throw std::invalid_argument("Bar volume must be positive.");
+            }
+            init_(file);
+        }
+
+        inline void TickDataImpl::init_(const std::string& file) {
+            print(fg(fmt::color::yellow), "Reading ticks in {}\n", file);
+            file_ = std::make_shared<TickFile>(file);
+            codes_ = file_->codes();
+            assets_ = static_cast<int>(codes_.size());
+            next_.resize(assets_);
+            volume_.resize(assets_);
+            rewind_(0);
+            BasePriceDataImpl::init();
+        }
 
+        inline std::shared_ptr<BasePriceDataImpl> TickDataImpl::clone() {
+            auto res = std::make_shared<TickDataImpl>(*this);
+            res->reset();
             return res;
         }
 
+        inline void TickDataImpl::rewind_(std::size_t pos) {
+            finished_ = false;
+            pos_ = pos;
+            next_.reset();
+            next_.volume.setZero();
+            next_.ticks = {};
+            rewind_adj_factors_();
+        }
+
+        inline void TickDataImpl::reset() {
+            BasePriceDataImpl::reset();
+            rewind_(0);
+        }
+
+        inline void TickDataImpl::seek(const ptime& time, int history) {
+            if (bar_volume_ > 0) {
+                rewind_(0);
+                return;
+            }
+            int64_t start = util::to_epoch_us(period_.start(period_.key(time) - history));
+            auto ticks = file_->ticks();
+            auto it = std::partition_point(ticks.begin(), ticks.end(),
+                [&](const Tick& t) { return t.time < start; });
+            rewind_(it - ticks.begin());
+        }
+
+        inline bool TickDataImpl::read() {
+            auto ticks = file_->ticks();
+            if (pos_ >= ticks.size()) {
+                finished_ = true;
+                return false;
+            }
+            std::size_t begin = pos_;
+            auto& d = next_.data;
+            d.open = d.close;
+            d.high = d.close;
+            d.low = d.close;
+            next_.valid.setConstant(false);
+            std::fill(volume_.begin(), volume_.end(), 0);
+
+            if (bar_volume_ > 0) {
+                build_<true>();
+                next_.time = util::from_epoch_us(ticks[pos_ - 1].time);
+            }
+            else {
+                end_ = util::to_epoch_us(
+                    period_.start(period_.key(util::from_epoch_us(ticks[pos_].time)) + 1));
+                build_<false>();
+                next_.time = util::from_epoch_us(end_);
+            }
+
+            for (int i = 0; i < assets_; ++i) {
+                next_.volume.coeffRef(i) =
+                    static_cast<int>(std::min<int64_t>(volume_[i], std::numeric_limits<int>::max()));
+            }
+            next_.adj_data = d;
+            if (intra_bar_ticks_) {
+                next_.ticks = ticks.subspan(begin, pos_ - begin);
+                next_.ticks_owner = file_;
+            }
+            apply_adj_factors_();
+            return true;
+        }
+
+        template <bool by_volume> inline void TickDataImpl::build_() {
+            auto ticks = file_->ticks();
+            double* open = next_.data.open.data();
+            double* high = next_.data.high.data();
+            double* low = next_.data.low.data();
+            double* close = next_.data.close.data();
+            bool* valid = next_.valid.data();
+            int64_t* volume = volume_.data();
+
+            int64_t last = ticks[pos_ > 0 ? pos_ - 1 : pos_].time, total = 0;
+            for (; pos_ < ticks.size(); ++pos_) {
+                const Tick& t = ticks[pos_];
+                if constexpr (!by_volume) {
+                    if (t.time >= end_) {
+                        break;
+                    }
+                }
+                if (t.time < last || t.asset < 0 || t.asset >= assets_) {
+                    throw std::runtime_error(fmt::format("Tick {} of {} is {}.", pos_, file_->name(),
+                        t.time < last ? "not in time order" : "of an unknown asset"));
+                }
+                last = t.time;
+                int i = t.asset;
+                if (!valid[i]) {
+                    open[i] = high[i] = low[i] = t.price;
+                    valid[i] = true;
+                }
+                else {
+                    high[i] = std::max(high[i], t.price);
+                    low[i] = std::min(low[i], t.price);
+                }
+                close[i] = t.price;
+                volume[i] += t.size;
+                if constexpr (by_volume) {
+                    if ((total += t.size) >= bar_volume_) {
+                        ++pos_;
+                        break;
+                    }
+                }
+            }
+        }
+
         CSVCommonDataImpl::CSVCommonDataImpl(const std::string& file,
-            TimeStrConv::func_type time_converter,
+            TimeParser time_converter,
             const std::vector<int> str_cols)
             : BaseCommonDataFeedImpl(time_converter), file(file),
             str_cols_(str_cols.begin(), str_cols.end()) {
@@ -848,47 +2146,67 @@ namespace backtradercpp {
         }
 
         bool CSVCommonDataImpl::read() {
-            std::getline(data_file_, next_row_);
-            if (data_file_.eof()) {
+            if (!data_file_.read_row() || data_file_.row().empty()) {
                 finished_ = true;
                 return false;
             }
-            auto row_string = CSVRowParaser::parse_row(next_row_);
-            auto& ts = row_string[0];
-            if (time_converter_) {
-                ts = time_converter_(ts);
+            const auto& row_string = data_file_.row();
+            next_.time = time_converter_.parse(row_string[0]);
+
+            for (std::size_t j = 0; j < num_fields_.size(); ++j) {
+                int col = num_fields_[j];
+                next_.num_data_[j] = std::size_t(col) < row_string.size()
+                    ? parse_cell_(data_file_, col)
+                    : std::numeric_limits<double>::quiet_NaN();
             }
-            next_.time = boost::posix_time::time_from_string(ts);
-
-            for (int i = 1; i < row_string.size(); ++i) {
-                if (!str_cols_.contains(i)) {
-                    next_.num_data_[col_names_[i - 1]] = CSVRowParaser::parse_double(row_string[i]);
+            for (std::size_t j = 0; j < str_fields_.size(); ++j) {
+                int col = str_fields_[j];
+                if (std::size_t(col) < row_string.size()) {
+                    next_.str_data_[j].assign(row_string[col]);
                 }
                 else {
-                    next_.str_data_[col_names_[i - 1]] = row_string[i];
+                    next_.str_data_[j].clear();
                 }
             }
-            // std::cout << util::format_map(next_.num_data_) << std::endl;
 
             return true;
         }
 
+        inline void CSVCommonDataImpl::seek(const ptime& time, int history) {
+            auto index = TimeIndex::get(file, 0, time_converter_);
+            index.seek(data_file_, index.find(time, history));
+            finished_ = false;
+        }
+
         std::shared_ptr<BaseCommonDataFeedImpl> CSVCommonDataImpl::clone() {
             auto res = std::make_shared<CSVCommonDataImpl>(*this);
             return res;
         }
         void CSVCommonDataImpl::init() { // Read header
 
-            data_file_ = std::ifstream(file);
-            std::string header;
-            std::getline(data_file_, header);
+            data_file_.open(file);
+            data_file_.read_row();
+            parse_errors_.clear();
 
-            // Read one line and set col_names.
-            auto row_string = CSVRowParaser::parse_row(header);
+            // Resolve columns from header.
+            const auto& row_string = data_file_.row();
+            auto schema = std::make_shared<FieldSchema>();
+            num_fields_.clear();
+            str_fields_.clear();
             for (int i = 1; i < row_string.size(); ++i) {
-                boost::algorithm::trim(row_string[i]);
-                col_names_.emplace_back(std::move(row_string[i]));
+                auto name = boost::algorithm::trim_copy(std::string(row_string[i]));
+                if (!str_cols_.contains(i)) {
+                    schema->add_num(name);
+                    num_fields_.push_back(i);
+                }
+                else {
+                    schema->add_str(name);
+                    str_fields_.push_back(i);
+                }
             }
+            next_.schema = schema;
+            next_.num_data_.assign(num_fields_.size(), std::numeric_limits<double>::quiet_NaN());
+            next_.str_data_.assign(str_fields_.size(), std::string());
         }
 
     } // namespace feeds
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "PricePanel.hpp"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace backtradercpp {
+    namespace feeds {
+        // Process wide store of parsed panels. key must contain everything that affects the content,
+        // e.g. files with their stamps, columns and time format. Feeds with the same key, including
+        // clones, share one immutable panel, which is released when no feed uses it.
+        class DatasetStore {
+        public:
+            using Loader = std::function<std::shared_ptr<const PricePanel>()>;
+
+            // Return panel of key, or load and keep it. Loading holds the store, so a panel is never
+            // loaded twice.
+            static std::shared_ptr<const PricePanel> get(const std::string& key, const Loader& load);
+
+        private:
+            static std::mutex& mutex_() {
+                static std::mutex m;
+                return m;
+            }
+            static std::unordered_map<std::string, std::weak_ptr<const PricePanel>>& panels_() {
+                static std::unordered_map<std::string, std::weak_ptr<const PricePanel>> panels;
+                return panels;
+            }
+        };
+
+        inline std::shared_ptr<const PricePanel> DatasetStore::get(const std::string& key,
+            const Loader& load) {
+            std::lock_guard lock(mutex_());
+            auto& panels = panels_();
+            // Drop panels that are no longer used.
+            std::erase_if(panels, [](const auto& item) { return item.second.expired(); });
+
+            if (auto it = panels.find(key); it != panels.end()) {
+                if (auto panel = it->second.lock()) {
+                    return panel;
+                }
+            }
+            auto panel = load();
+            panels[key] = panel;
+            return panel;
+        }
+    } // namespace feeds
+} // namespace backtradercpp
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "CSVParser.hpp"
+#include "TimeParser.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace backtradercpp {
+    namespace feeds {
+        // Sparse point-in-time events (time, asset, field, value), e.g. quarterly fundamentals. Events
+        // are sorted by time and stored by columns, events at the same time keep their order in file.
+        // Assets and fields are codes into codes() and fields().
+        class EventTable {
+        public:
+            // Wide file has a time column, a code column and one column per field, empty cells are not
+            // events. If field_col >= 0, the file is long instead: each row is one event, with name of
+            // field in field_col and value in value_col.
+            static std::shared_ptr<EventTable> read_csv(const std::string& file,
+                const TimeParser& time_parser, int time_col = 0, int code_col = 1, int field_col = -1,
+                int value_col = -1);
+
+            int size() const { return static_cast<int>(times_.size()); }
+            const auto& codes() const { return codes_; }
+            const auto& fields() const { return fields_; }
+
+            int64_t time(int k) const { return times_[k]; } // Microseconds since epoch.
+            int asset(int k) const { return assets_[k]; }
+            int field(int k) const { return fields_of_[k]; }
+            double value(int k) const { return values_[k]; }
+
+            // Cells that are not numbers. Empty cells are not counted.
+            const ParseErrors& parse_errors() const { return parse_errors_; }
+
+        private:
+            void sort_();
+
+            std::vector<int64_t> times_;
+            std::vector<int> assets_, fields_of_;
+            std::vector<double> values_;
+
+            std::vector<std::string> codes_, fields_;
+            ParseErrors parse_errors_;
+        };
+
+        inline std::shared_ptr<EventTable> EventTable::read_csv(const std::string& file,
+            const TimeParser& time_parser, int time_col, int code_col, int field_col, int value_col) {
+            util::check_path_exists(file);
+            auto table = std::make_shared<EventTable>();
+            auto& t = *table;
+
+            std::unordered_map<std::string, int> code_index, field_index;
+            auto index_of = [](auto& index, auto& names, std::string_view s) {
+                auto [it, added] = index.try_emplace(std::string(s), static_cast<int>(names.size()));
+                if (added) {
+                    names.emplace_back(s);
+                }
+                return it->second;
+            };
+
+            CSVReader reader(file);
+            reader.read_row();
+            // Value columns and their fields. Fields of long file are read from rows.
+            std::vector<int> value_cols, value_fields;
+            if (field_col < 0) {
+                const auto& header = reader.row();
+                for (int c = 0; c < static_cast<int>(header.size()); ++c) {
+                    if (c != time_col && c != code_col) {
+                        value_cols.push_back(c);
+                        value_fields.push_back(index_of(field_index, t.fields_, header[c]));
+                    }
+                }
+            }
+            else {
+                value_cols.push_back(value_col);
+            }
+
+            while (reader.read_row() && !reader.row().empty()) {
+                const auto& row = reader.row();
+                // Trailing empty cells may be left off.
+                auto cell = [&](int c) {
+                    return std::size_t(c) < row.size() ? row[c] : std::string_view();
+                };
+                int64_t time = util::to_epoch_us(time_parser.parse(cell(time_col)));
+                int asset = index_of(code_index, t.codes_, cell(code_col));
+                for (std::size_t j = 0; j < value_cols.size(); ++j) {
+                    double value;
+                    auto status = parse_double(cell(value_cols[j]), value);
+                    if (status != ParseStatus::Ok) {
+                        if (status == ParseStatus::Failed) {
+                            t.parse_errors_.record(status, reader, value_cols[j]);
+                        }
+                        continue;
+                    }
+                    t.times_.push_back(time);
+                    t.assets_.push_back(asset);
+                    t.fields_of_.push_back(field_col < 0
+                        ? value_fields[j]
+                        : index_of(field_index, t.fields_, cell(field_col)));
+                    t.values_.push_back(value);
+                }
+            }
+            t.sort_();
+            return table;
+        }
+
+        inline void EventTable::sort_() {
+            if (std::is_sorted(times_.begin(), times_.end())) {
+                return;
+            }
+            std::vector<int> order(times_.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(),
+                [&](int a, int b) { return times_[a] < times_[b]; });
+            auto permute = [&](auto& v) {
+                std::remove_reference_t<decltype(v)> res(v.size());
+                for (std::size_t k = 0; k < order.size(); ++k) {
+                    res[k] = v[order[k]];
+                }
+                v = std::move(res);
+            };
+            permute(times_);
+            permute(assets_);
+            permute(fields_of_);
+            permute(values_);
+        }
+    } // namespace feeds
+} // namespace backtradercpp
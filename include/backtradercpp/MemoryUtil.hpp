@@ -0,0 +1,329 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace backtradercpp {
+    namespace util {
+        // Read-only memory mapping of a whole file. The file handle is released right after mapping,
+        // so a mapped file doesn't occupy a file descriptor.
+        class MappedFile {
+        public:
+            MappedFile() = default;
+            explicit MappedFile(const std::filesystem::path& path) { open(path); }
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+            MappedFile(MappedFile&& other) noexcept { swap(other); }
+            MappedFile& operator=(MappedFile&& other) noexcept {
+                close();
+                swap(other);
+                return *this;
+            }
+            ~MappedFile() { close(); }
+
+            void open(const std::filesystem::path& path);
+            void close();
+
+            const char* data() const { return data_; }
+            std::size_t size() const { return size_; }
+            bool is_open() const { return opened_; }
+
+        private:
+            void swap(MappedFile& other) noexcept {
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+                std::swap(opened_, other.opened_);
+            }
+
+            const char* data_ = nullptr;
+            std::size_t size_ = 0;
+            bool opened_ = false;
+        };
+
+        // Zeroed memory whose pages are mapped twice back to back, i.e. data()[i + size()] is
+        // data()[i], so size() bytes from any offset below size() are contiguous. Used for rings
+        // whose window is read as one block. size is rounded up to a multiple of granularity().
+        class MirroredBuffer {
+        public:
+            MirroredBuffer() = default;
+            explicit MirroredBuffer(std::size_t size) { allocate(size); }
+            MirroredBuffer(const MirroredBuffer& other) : MirroredBuffer(other.size_) {
+                if (size_ > 0) {
+                    std::memcpy(data_, other.data_, size_);
+                }
+            }
+            MirroredBuffer& operator=(const MirroredBuffer& other) {
+                MirroredBuffer copy(other);
+                swap(copy);
+                return *this;
+            }
+            MirroredBuffer(MirroredBuffer&& other) noexcept { swap(other); }
+            MirroredBuffer& operator=(MirroredBuffer&& other) noexcept {
+                release();
+                swap(other);
+                return *this;
+            }
+            ~MirroredBuffer() { release(); }
+
+            // Throw std::runtime_error if memory can't be mapped.
+            void allocate(std::size_t size);
+            void release();
+
+            char* data() const { return data_; }
+            std::size_t size() const { return size_; }
+            // Page size, or allocation granularity on Windows.
+            static std::size_t granularity();
+
+        private:
+            void swap(MirroredBuffer& other) noexcept {
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+            }
+
+            char* data_ = nullptr;
+            std::size_t size_ = 0;
+        };
+
+        // Files opened for reading by blocks. At most capacity files are kept open, the least recently
+        // used one is closed when another file has to be opened. It can be shared by several threads.
+        class FilePool {
+        public:
+            explicit FilePool(std::size_t capacity) : capacity_(capacity > 0 ? capacity : 1) {}
+            FilePool(const FilePool&) = delete;
+            FilePool& operator=(const FilePool&) = delete;
+
+            // Read at most size bytes at offset of file into buf. Return number of bytes read.
+            std::size_t read(const std::string& file, std::size_t offset, char* buf, std::size_t size);
+
+            std::size_t capacity() const { return capacity_; }
+
+        private:
+            using Entry = std::pair<std::string, std::ifstream>;
+
+            std::size_t capacity_;
+            std::list<Entry> files_; // Most recently used first.
+            std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+            std::mutex mutex_;
+        };
+
+        inline std::size_t FilePool::read(const std::string& file, std::size_t offset, char* buf,
+            std::size_t size) {
+            std::lock_guard lock(mutex_);
+            auto it = index_.find(file);
+            if (it != index_.end()) {
+                files_.splice(files_.begin(), files_, it->second);
+            }
+            else {
+                if (files_.size() >= capacity_) {
+                    index_.erase(files_.back().first);
+                    files_.pop_back();
+                }
+                std::ifstream in(std::filesystem::path(file), std::ios::binary);
+                if (!in) {
+                    throw std::runtime_error("Can't open file " + file + ".");
+                }
+                files_.emplace_front(file, std::move(in));
+                index_.emplace(file, files_.begin());
+            }
+            auto& in = files_.front().second;
+            in.clear();
+            in.seekg(static_cast<std::streamoff>(offset));
+            in.read(buf, static_cast<std::streamsize>(size));
+            return static_cast<std::size_t>(in.gcount());
+        }
+
+#ifdef _WIN32
+        inline void MappedFile::open(const std::filesystem::path& path) {
+            close();
+            HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                throw std::runtime_error("Can't open file " + path.string() + ".");
+            }
+            LARGE_INTEGER file_size;
+            GetFileSizeEx(file, &file_size);
+            size_ = static_cast<std::size_t>(file_size.QuadPart);
+            if (size_ > 0) {
+                HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping != nullptr) {
+                    data_ = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                    CloseHandle(mapping);
+                }
+                if (data_ == nullptr) {
+                    CloseHandle(file);
+                    throw std::runtime_error("Can't map file " + path.string() + ".");
+                }
+            }
+            CloseHandle(file);
+            opened_ = true;
+        }
+        inline void MappedFile::close() {
+            if (data_ != nullptr) {
+                UnmapViewOfFile(data_);
+            }
+            data_ = nullptr;
+            size_ = 0;
+            opened_ = false;
+        }
+
+        inline std::size_t MirroredBuffer::granularity() {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return info.dwAllocationGranularity;
+        }
+        inline void MirroredBuffer::allocate(std::size_t size) {
+            release();
+            size = (size + granularity() - 1) / granularity() * granularity();
+            if (size == 0) {
+                return;
+            }
+            HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                static_cast<DWORD>(uint64_t(size) >> 32), static_cast<DWORD>(size), nullptr);
+            if (mapping == nullptr) {
+                throw std::runtime_error("Can't allocate ring buffer.");
+            }
+            // Find free address space for both views, then map them there. Another thread may take
+            // the space in between, so try again.
+            for (int attempt = 0; attempt < 16 && data_ == nullptr; ++attempt) {
+                auto base = static_cast<char*>(
+                    VirtualAlloc(nullptr, 2 * size, MEM_RESERVE, PAGE_NOACCESS));
+                if (base == nullptr) {
+                    break;
+                }
+                VirtualFree(base, 0, MEM_RELEASE);
+                void* first = MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size, base);
+                void* second = first != nullptr
+                    ? MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size, base + size)
+                    : nullptr;
+                if (second != nullptr) {
+                    data_ = base;
+                }
+                else if (first != nullptr) {
+                    UnmapViewOfFile(first);
+                }
+            }
+            CloseHandle(mapping);
+            if (data_ == nullptr) {
+                throw std::runtime_error("Can't map ring buffer.");
+            }
+            size_ = size;
+        }
+        inline void MirroredBuffer::release() {
+            if (data_ != nullptr) {
+                UnmapViewOfFile(data_);
+                UnmapViewOfFile(data_ + size_);
+            }
+            data_ = nullptr;
+            size_ = 0;
+        }
+#else
+        inline void MappedFile::open(const std::filesystem::path& path) {
+            close();
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("Can't open file " + path.string() + ".");
+            }
+            struct stat st;
+            ::fstat(fd, &st);
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ > 0) {
+                void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error("Can't map file " + path.string() + ".");
+                }
+                ::madvise(p, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(p);
+            }
+            ::close(fd);
+            opened_ = true;
+        }
+        inline void MappedFile::close() {
+            if (data_ != nullptr) {
+                ::munmap(const_cast<char*>(data_), size_);
+            }
+            data_ = nullptr;
+            size_ = 0;
+            opened_ = false;
+        }
+
+        inline std::size_t MirroredBuffer::granularity() {
+            static const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            return page;
+        }
+        inline void MirroredBuffer::allocate(std::size_t size) {
+            release();
+            size = (size + granularity() - 1) / granularity() * granularity();
+            if (size == 0) {
+                return;
+            }
+#ifdef __linux__
+            int fd = ::memfd_create("backtradercpp_ring", MFD_CLOEXEC);
+#else
+            static std::atomic<unsigned> count{ 0 };
+            std::string name = "/backtradercpp_" + std::to_string(::getpid()) + "_" +
+                std::to_string(count.fetch_add(1));
+            int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd >= 0) {
+                ::shm_unlink(name.c_str());
+            }
+#endif
+            if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                throw std::runtime_error("Can't allocate ring buffer.");
+            }
+            // Reserve address space for both views, then map the file over it twice.
+            void* p = ::mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            auto base = static_cast<char*>(p);
+            bool ok = p != MAP_FAILED;
+            for (char* view : { base, base + size }) {
+                ok = ok && ::mmap(view, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+                    0) != MAP_FAILED;
+            }
+            ::close(fd);
+            if (!ok) {
+                if (p != MAP_FAILED) {
+                    ::munmap(p, 2 * size);
+                }
+                throw std::runtime_error("Can't map ring buffer.");
+            }
+            data_ = base;
+            size_ = size;
+        }
+        inline void MirroredBuffer::release() {
+            if (data_ != nullptr) {
+                ::munmap(data_, 2 * size_);
+            }
+            data_ = nullptr;
+            size_ = 0;
+        }
+#endif
+    } // namespace util
+} // namespace backtradercpp
@@ -0,0 +1,374 @@
+#pragma once
+
+#include "Common.hpp"
+#include "CSVParser.hpp"
+#include "MemoryUtil.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+namespace backtradercpp {
+    namespace feeds {
+        // All rows of one asset, e.g. a raw data file and its adjusted data file.
+        struct AssetSeries {
+            std::vector<ptime> times;
+            // raw open, high, low, close, then adjusted open, high, low, close.
+            std::array<std::vector<double>, 8> ohlc;
+            std::vector<std::vector<double>> num;
+            std::vector<std::vector<std::string>> str;
+        };
+
+        // Dense time x asset panel. Each field is stored row-major, so all assets of a bar are
+        // contiguous. If an asset has no data at a time, its values are 0 (or "" for string columns),
+        // the same as what a streaming feed gives after PriceFeedData::reset().
+        //
+        // A panel is either built in memory from AssetSeries, or mapped from a binary file written by
+        // save(). Binary layout (native byte order, sections aligned to 64 bytes):
+        //   magic, version, manifest, rows, assets, num cols, str cols, string dictionaries,
+        //   times (int64 us since epoch), printed flags (uint8), 8 + num cols double fields,
+        //   str cols int32 dictionary codes.
+        class PricePanel {
+        public:
+            enum Field { Open, High, Low, Close, AdjOpen, AdjHigh, AdjLow, AdjClose, OHLCFields };
+
+            PricePanel() = default;
+            PricePanel(const PricePanel&) = delete;
+            PricePanel& operator=(const PricePanel&) = delete;
+
+            // Series are consumed. If adjusted series are all empty, adjusted fields share storage of
+            // raw fields.
+            static std::shared_ptr<PricePanel> build(std::vector<AssetSeries>& series, int num_cols,
+                int str_cols);
+            // Panel where all assets have data at all times and OHLC are the same value, e.g. a
+            // tabular file. raw and adj are row-major cells and are consumed. If adj is empty, it is
+            // the same as raw.
+            static std::shared_ptr<PricePanel> build_tabular(std::vector<ptime>& times, int assets,
+                std::vector<double>& raw, std::vector<double>& adj);
+            // Return nullptr if file doesn't exist or was written with a different manifest.
+            static std::shared_ptr<PricePanel> load(const std::string& file, const std::string& manifest);
+            void save(const std::string& file, const std::string& manifest) const;
+
+            int rows() const { return rows_; }
+            int assets() const { return assets_; }
+            int num_cols() const { return static_cast<int>(fields_.size()) - OHLCFields; }
+            int str_cols() const { return static_cast<int>(str_fields_.size()); }
+
+            ptime time(int row) const { return util::from_epoch_us(times_[row]); }
+            // First row at or after time.
+            int lower_bound(const ptime& time) const {
+                return static_cast<int>(
+                    std::lower_bound(times_, times_ + rows_, util::to_epoch_us(time)) - times_);
+            }
+            // field is a Field or OHLCFields + index of extra numeric column.
+            const double* row(int field, int row) const {
+                return fields_[field] + static_cast<std::size_t>(row) * assets_;
+            }
+            const int32_t* str_row(int col, int row) const {
+                return str_fields_[col] + static_cast<std::size_t>(row) * assets_;
+            }
+            const std::string& str_value(int col, int32_t code) const { return dicts_[col][code]; }
+            int str_dict_size(int col) const { return static_cast<int>(dicts_[col].size()); }
+            const uint8_t* printed(int row) const {
+                return printed_ + static_cast<std::size_t>(row) * assets_;
+            }
+            // Bad cells found when the panel was parsed, none if it was loaded from file. Every feed
+            // sharing the panel reports them.
+            const ParseErrors& parse_errors() const { return parse_errors_; }
+            void set_parse_errors(const ParseErrors& errors) { parse_errors_ = errors; }
+
+        private:
+            static constexpr char magic_[8] = { 'B', 'K', 'P', 'A', 'N', 'E', 'L', '\0' };
+            static constexpr uint64_t version_ = 1;
+            static constexpr std::size_t align_ = 64;
+
+            int rows_ = 0, assets_ = 0;
+
+            const int64_t* times_ = nullptr;
+            const uint8_t* printed_ = nullptr;
+            std::vector<const double*> fields_;
+            std::vector<const int32_t*> str_fields_;
+            std::vector<std::vector<std::string>> dicts_;
+
+            // Owned storage when built in memory.
+            std::vector<int64_t> own_times_;
+            std::vector<uint8_t> own_printed_;
+            std::vector<std::vector<double>> own_fields_;
+            std::vector<std::vector<int32_t>> own_str_fields_;
+            // Owned storage when loaded from file.
+            util::MappedFile mapping_;
+            ParseErrors parse_errors_;
+        };
+
+        inline std::shared_ptr<PricePanel> PricePanel::build(std::vector<AssetSeries>& series,
+            int num_cols, int str_cols) {
+            auto panel = std::make_shared<PricePanel>();
+            auto& p = *panel;
+
+            // Union of all times.
+            std::vector<ptime> times;
+            for (const auto& s : series) {
+                times.insert(times.end(), s.times.begin(), s.times.end());
+            }
+            std::sort(times.begin(), times.end());
+            times.erase(std::unique(times.begin(), times.end()), times.end());
+
+            p.rows_ = static_cast<int>(times.size());
+            p.assets_ = static_cast<int>(series.size());
+            std::size_t cells = static_cast<std::size_t>(p.rows_) * p.assets_;
+
+            p.own_times_.resize(p.rows_);
+            for (int r = 0; r < p.rows_; ++r) {
+                p.own_times_[r] = util::to_epoch_us(times[r]);
+            }
+            bool has_adj = std::any_of(series.begin(), series.end(),
+                [](const AssetSeries& s) { return !s.ohlc[AdjOpen].empty(); });
+            int ohlc_fields = has_adj ? OHLCFields : AdjOpen;
+            // Storage of field f.
+            auto slot = [&](int f) {
+                if (has_adj) {
+                    return f;
+                }
+                return f < OHLCFields ? f % AdjOpen : f - AdjOpen;
+            };
+
+            p.own_printed_.assign(cells, 0);
+            p.own_fields_.assign(ohlc_fields + num_cols, std::vector<double>(cells, 0));
+            p.own_str_fields_.assign(str_cols, std::vector<int32_t>(cells, 0));
+            p.dicts_.assign(str_cols, std::vector<std::string>{ "" });
+
+            std::vector<std::unordered_map<std::string, int32_t>> dict_index(str_cols);
+            for (auto& d : dict_index) {
+                d[""] = 0;
+            }
+
+            // Assets fill different cells, only string dictionaries are shared.
+#pragma omp parallel for
+            for (int a = 0; a < p.assets_; ++a) {
+                const auto& s = series[a];
+                auto it = times.begin();
+                for (std::size_t k = 0; k < s.times.size(); ++k) {
+                    it = std::lower_bound(it, times.end(), s.times[k]);
+                    std::size_t cell = static_cast<std::size_t>(it - times.begin()) * p.assets_ + a;
+                    p.own_printed_[cell] = 1;
+                    for (int f = 0; f < ohlc_fields; ++f) {
+                        p.own_fields_[f][cell] = s.ohlc[f][k];
+                    }
+                    for (int j = 0; j < num_cols; ++j) {
+                        p.own_fields_[ohlc_fields + j][cell] = s.num[j][k];
+                    }
+                }
+            }
+            for (int a = 0; a < p.assets_; ++a) {
+                auto& s = series[a];
+                if (str_cols > 0) {
+                    auto it = times.begin();
+                    for (std::size_t k = 0; k < s.times.size(); ++k) {
+                        it = std::lower_bound(it, times.end(), s.times[k]);
+                        std::size_t cell = static_cast<std::size_t>(it - times.begin()) * p.assets_ + a;
+                        for (int j = 0; j < str_cols; ++j) {
+                            auto [pos, inserted] = dict_index[j].try_emplace(s.str[j][k],
+                                static_cast<int32_t>(p.dicts_[j].size()));
+                            if (inserted) {
+                                p.dicts_[j].push_back(s.str[j][k]);
+                            }
+                            p.own_str_fields_[j][cell] = pos->second;
+                        }
+                    }
+                }
+                s = AssetSeries();
+            }
+
+            p.times_ = p.own_times_.data();
+            p.printed_ = p.own_printed_.data();
+            for (int f = 0; f < OHLCFields + num_cols; ++f) {
+                p.fields_.push_back(p.own_fields_[slot(f)].data());
+            }
+            for (const auto& f : p.own_str_fields_) {
+                p.str_fields_.push_back(f.data());
+            }
+            return panel;
+        }
+
+        inline std::shared_ptr<PricePanel> PricePanel::build_tabular(std::vector<ptime>& times,
+            int assets, std::vector<double>& raw, std::vector<double>& adj) {
+            auto panel = std::make_shared<PricePanel>();
+            auto& p = *panel;
+            p.rows_ = static_cast<int>(times.size());
+            p.assets_ = assets;
+
+            p.own_times_.resize(p.rows_);
+            for (int r = 0; r < p.rows_; ++r) {
+                p.own_times_[r] = util::to_epoch_us(times[r]);
+            }
+            p.own_printed_.assign(static_cast<std::size_t>(p.rows_) * assets, 1);
+            p.own_fields_.push_back(std::move(raw));
+            if (!adj.empty()) {
+                p.own_fields_.push_back(std::move(adj));
+            }
+
+            // OHLC fields share the same storage.
+            p.times_ = p.own_times_.data();
+            p.printed_ = p.own_printed_.data();
+            for (int f = 0; f < OHLCFields; ++f) {
+                p.fields_.push_back(p.own_fields_[f < AdjOpen ? 0 : p.own_fields_.size() - 1].data());
+            }
+            return panel;
+        }
+
+        inline void PricePanel::save(const std::string& file, const std::string& manifest) const {
+            std::string tmp_file = file + ".tmp";
+            {
+                std::ofstream f(tmp_file, std::ios::binary);
+                if (!f) {
+                    print(fg(fmt::color::red), "Can't write cache file {}.\n", file);
+                    return;
+                }
+                std::size_t pos = 0;
+                auto write = [&](const void* p, std::size_t n) {
+                    f.write(static_cast<const char*>(p), n);
+                    pos += n;
+                };
+                auto write_u64 = [&](uint64_t v) { write(&v, sizeof(v)); };
+                auto write_str = [&](const std::string& s) {
+                    write_u64(s.size());
+                    write(s.data(), s.size());
+                };
+                auto pad = [&]() {
+                    static const char zeros[align_] = {};
+                    write(zeros, (align_ - pos % align_) % align_);
+                };
+
+                write(magic_, sizeof(magic_));
+                write_u64(version_);
+                write_str(manifest);
+                for (uint64_t v : { uint64_t(rows_), uint64_t(assets_), uint64_t(num_cols()),
+                                   uint64_t(str_cols()) }) {
+                    write_u64(v);
+                }
+                for (const auto& d : dicts_) {
+                    write_u64(d.size());
+                    for (const auto& s : d) {
+                        write_str(s);
+                    }
+                }
+
+                std::size_t cells = static_cast<std::size_t>(rows_) * assets_;
+                pad();
+                write(times_, sizeof(int64_t) * rows_);
+                pad();
+                write(printed_, cells);
+                for (const auto* field : fields_) {
+                    pad();
+                    write(field, sizeof(double) * cells);
+                }
+                for (const auto* field : str_fields_) {
+                    pad();
+                    write(field, sizeof(int32_t) * cells);
+                }
+                if (!f) {
+                    print(fg(fmt::color::red), "Failed to write cache file {}.\n", file);
+                    return;
+                }
+            }
+            std::error_code ec;
+            std::filesystem::rename(tmp_file, file, ec);
+            if (ec) {
+                print(fg(fmt::color::red), "Can't write cache file {}: {}\n", file, ec.message());
+            }
+        }
+
+        inline std::shared_ptr<PricePanel> PricePanel::load(const std::string& file,
+            const std::string& manifest) {
+            if (!std::filesystem::exists(file)) {
+                return nullptr;
+            }
+            auto panel = std::make_shared<PricePanel>();
+            auto& p = *panel;
+            p.mapping_.open(file);
+
+            const char* begin = p.mapping_.data();
+            std::size_t size = p.mapping_.size(), pos = 0;
+            bool truncated = false;
+            auto take = [&](std::size_t n) -> const char* {
+                if (pos + n > size) {
+                    truncated = true;
+                    return nullptr;
+                }
+                const char* res = begin + pos;
+                pos += n;
+                return res;
+            };
+            auto read_u64 = [&](uint64_t& v) {
+                const char* s = take(sizeof(v));
+                if (s != nullptr) {
+                    std::memcpy(&v, s, sizeof(v));
+                }
+                return s != nullptr;
+            };
+            auto read_str = [&](std::string_view& v) {
+                uint64_t n = 0;
+                if (!read_u64(n)) {
+                    return false;
+                }
+                const char* s = take(n);
+                if (s != nullptr) {
+                    v = std::string_view(s, n);
+                }
+                return s != nullptr;
+            };
+            auto align = [&]() { pos += (align_ - pos % align_) % align_; };
+
+            const char* magic = take(sizeof(magic_));
+            uint64_t version = 0;
+            std::string_view file_manifest;
+            if (magic == nullptr || std::memcmp(magic, magic_, sizeof(magic_)) != 0 ||
+                !read_u64(version) || version != version_ || !read_str(file_manifest) ||
+                file_manifest != manifest) {
+                return nullptr;
+            }
+
+            uint64_t rows = 0, assets = 0, num_cols = 0, str_cols = 0;
+            if (!(read_u64(rows) && read_u64(assets) && read_u64(num_cols) && read_u64(str_cols))) {
+                return nullptr;
+            }
+            p.rows_ = static_cast<int>(rows);
+            p.assets_ = static_cast<int>(assets);
+            p.dicts_.resize(str_cols);
+            for (auto& d : p.dicts_) {
+                uint64_t n = 0;
+                if (!read_u64(n)) {
+                    return nullptr;
+                }
+                d.resize(n);
+                for (auto& s : d) {
+                    std::string_view v;
+                    if (!read_str(v)) {
+                        return nullptr;
+                    }
+                    s = v;
+                }
+            }
+
+            std::size_t cells = rows * assets;
+            align();
+            p.times_ = reinterpret_cast<const int64_t*>(take(sizeof(int64_t) * rows));
+            align();
+            p.printed_ = reinterpret_cast<const uint8_t*>(take(cells));
+            for (uint64_t i = 0; i < OHLCFields + num_cols; ++i) {
+                align();
+                p.fields_.push_back(reinterpret_cast<const double*>(take(sizeof(double) * cells)));
+            }
+            for (uint64_t i = 0; i < str_cols; ++i) {
+                align();
+                p.str_fields_.push_back(reinterpret_cast<const int32_t*>(take(sizeof(int32_t) * cells)));
+            }
+            if (truncated) {
+                return nullptr;
+            }
+            return panel;
+        }
+    } // namespace feeds
+} // namespace backtradercpp
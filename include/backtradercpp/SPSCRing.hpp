@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace backtradercpp {
+    namespace util {
+        // Bounded single-producer single-consumer ring of pre-allocated slots. Slots are reused, so
+        // allocations inside them are kept between rounds. Producer fills the slot returned by
+        // acquire() and publishes it by push(); consumer reads front() and releases it by pop().
+        // Both sides only block when the ring is full or empty.
+        template <typename T> class SPSCRing {
+        public:
+            explicit SPSCRing(std::size_t capacity) : slots_(capacity > 0 ? capacity : 1) {}
+            SPSCRing(const SPSCRing&) = delete;
+            SPSCRing& operator=(const SPSCRing&) = delete;
+
+            std::size_t capacity() const { return slots_.size(); }
+
+            // Producer: wait for a free slot. Return nullptr if the ring is closed.
+            T* acquire();
+            void push();
+
+            // Consumer: wait for a published slot. Return nullptr if the ring is closed and empty.
+            T* front();
+            void pop();
+
+            // Wake up both sides, e.g. consumer stops early.
+            void close();
+
+        private:
+            void notify_() {
+                seq_.fetch_add(1, std::memory_order_release);
+                seq_.notify_all();
+            }
+            template <typename F> bool wait_(F ready);
+
+            std::vector<T> slots_;
+            alignas(64) std::atomic<std::size_t> head_{ 0 }; // Slots popped.
+            alignas(64) std::atomic<std::size_t> tail_{ 0 }; // Slots pushed.
+            // Changed on every push, pop and close. Waiting side sleeps on it.
+            alignas(64) std::atomic<uint32_t> seq_{ 0 };
+            std::atomic<bool> closed_{ false };
+        };
+
+        template <typename T> template <typename F> inline bool SPSCRing<T>::wait_(F ready) {
+            for (int spin = 0; spin < 64; ++spin) {
+                if (ready()) {
+                    return true;
+                }
+            }
+            while (true) {
+                auto s = seq_.load(std::memory_order_acquire);
+                if (ready()) {
+                    return true;
+                }
+                if (closed_.load(std::memory_order_acquire)) {
+                    return false;
+                }
+                seq_.wait(s, std::memory_order_acquire);
+            }
+        }
+
+        template <typename T> inline T* SPSCRing<T>::acquire() {
+            auto tail = tail_.load(std::memory_order_relaxed);
+            bool ok = wait_([&] {
+                return tail - head_.load(std::memory_order_acquire) < slots_.size();
+            });
+            if (!ok || closed_.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            return &slots_[tail % slots_.size()];
+        }
+
+        template <typename T> inline void SPSCRing<T>::push() {
+            tail_.fetch_add(1, std::memory_order_release);
+            notify_();
+        }
+
+        template <typename T> inline T* SPSCRing<T>::front() {
+            auto head = head_.load(std::memory_order_relaxed);
+            bool ok = wait_([&] { return tail_.load(std::memory_order_acquire) != head; });
+            if (!ok) {
+                return nullptr;
+            }
+            return &slots_[head % slots_.size()];
+        }
+
+        template <typename T> inline void SPSCRing<T>::pop() {
+            head_.fetch_add(1, std::memory_order_release);
+            notify_();
+        }
+
+        template <typename T> inline void SPSCRing<T>::close() {
+            closed_.store(true, std::memory_order_release);
+            notify_();
+        }
+    } // namespace util
+} // namespace backtradercpp
@@ -423,8 +423,9 @@ namespace backtradercpp {
             VecArrXd target_value = wealth(broker_id) * TOTAL_FRACTION * w;
             VecArrXi target_volume = (target_value / (target_prices * UNIT)).cast<int>();
             VecArrXi volume_diff = target_volume - positions(broker_id);
+            auto valid = data(broker_id).valid();
             for (int i = 0; i < volume_diff.size(); ++i) {
-                if (data(broker_id).valid().coeff(i) && (volume_diff.coeff(i) != 0)) {
+                if (valid.coeff(i) && (volume_diff.coeff(i) != 0)) {
                     buy(broker_id, i, target_prices.coeff(i), volume_diff.coeff(i));
                 }
             }
@@ -437,8 +438,9 @@ namespace backtradercpp {
                 target_prices = p;
             }
             VecArrXi volume_diff = target_volume - positions(broker_id);
+            auto valid = data(broker_id).valid();
             for (int i = 0; i < volume_diff.size(); ++i) {
-                if (data(broker_id).valid().coeff(i) && (volume_diff.coeff(i) != 0)) {
+                if (valid.coeff(i) && (volume_diff.coeff(i) != 0)) {
                     buy(broker_id, i, target_prices.coeff(i), volume_diff.coeff(i));
                 }
             }
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Common.hpp"
+#include "MemoryUtil.hpp"
+#include "util.hpp"
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace backtradercpp {
+    namespace feeds {
+        // Binary file of ticks, in native byte order: magic, number of assets and byte size of codes as
+        // int64, codes separated by '\n' and padded to 8 bytes, then Tick records in time order till
+        // the end of file. Records are read in place from a memory mapping.
+        class TickFile {
+        public:
+            static constexpr char magic[8] = { 'B', 'K', 'T', 'I', 'C', 'K', '0', '1' };
+
+            explicit TickFile(const std::string& file);
+            // Asset of a tick is its index in codes.
+            static void write(const std::string& file, const std::vector<std::string>& codes,
+                std::span<const Tick> ticks);
+
+            const std::string& name() const { return name_; }
+            const auto& codes() const { return codes_; }
+            std::span<const Tick> ticks() const { return ticks_; }
+
+        private:
+            util::MappedFile file_;
+            std::string name_;
+            std::vector<std::string> codes_;
+            std::span<const Tick> ticks_;
+        };
+
+        inline TickFile::TickFile(const std::string& file) : name_(file) {
+            util::check_path_exists(file);
+            file_.open(file);
+            const char* data = file_.data();
+            std::size_t size = file_.size();
+
+            int64_t header[2];
+            constexpr std::size_t header_size = sizeof(magic) + sizeof(header);
+            if (size < header_size || std::memcmp(data, magic, sizeof(magic)) != 0) {
+                throw std::runtime_error(file + " is not a tick file.");
+            }
+            std::memcpy(header, data + sizeof(magic), sizeof(header));
+            auto [assets, codes_size] = header;
+            std::size_t begin = header_size + (codes_size + 7) / 8 * 8;
+            if (assets < 0 || codes_size < 0 || begin > size || (size - begin) % sizeof(Tick) != 0) {
+                throw std::runtime_error("Corrupted tick file " + file + ".");
+            }
+
+            std::string_view codes(data + header_size, codes_size);
+            for (std::size_t k = 0; int64_t(codes_.size()) < assets && k <= codes.size();) {
+                auto end = std::min(codes.find('\n', k), codes.size());
+                codes_.emplace_back(codes.substr(k, end - k));
+                k = end + 1;
+            }
+            if (int64_t(codes_.size()) != assets) {
+                throw std::runtime_error("Corrupted tick file " + file + ".");
+            }
+            // Mapping is page aligned, so records are aligned.
+            ticks_ = { reinterpret_cast<const Tick*>(data + begin), (size - begin) / sizeof(Tick) };
+        }
+
+        inline void TickFile::write(const std::string& file, const std::vector<std::string>& codes,
+            std::span<const Tick> ticks) {
+            std::string joined;
+            for (const auto& code : codes) {
+                if (&code != &codes.front()) {
+                    joined += '\n';
+                }
+                joined += code;
+            }
+            int64_t header[2] = { static_cast<int64_t>(codes.size()),
+                static_cast<int64_t>(joined.size()) };
+            joined.resize((joined.size() + 7) / 8 * 8, '\n');
+
+            std::ofstream out(file, std::ios::binary);
+            if (!out) {
+                throw std::runtime_error("Can't write tick file " + file + ".");
+            }
+            out.write(magic, sizeof(magic));
+            out.write(reinterpret_cast<const char*>(header), sizeof(header));
+            out.write(joined.data(), joined.size());
+            out.write(reinterpret_cast<const char*>(ticks.data()), ticks.size_bytes());
+        }
+    } // namespace feeds
+} // namespace backtradercpp
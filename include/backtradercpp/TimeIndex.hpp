@@ -0,0 +1,178 @@
+#pragma once
+
+#include "CSVParser.hpp"
+#include "TimeParser.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace backtradercpp {
+    namespace feeds {
+        // Sparse index from time to position of rows in a csv file sorted by time, one entry every
+        // `stride` rows. It is saved next to the file as <file>.bkidx and rebuilt if the file, time
+        // column or time format changes. Note that a custom time_converter function is not tracked.
+        class TimeIndex {
+        public:
+            struct Entry {
+                int64_t time;    // Time of the row, microseconds since epoch.
+                uint64_t offset; // Offset of the row in file.
+                uint64_t line;   // Number of lines before the row.
+            };
+            static constexpr int stride = 256;
+            static constexpr const char* extension = ".bkidx";
+
+            // Load index of file, or build and save it.
+            static TimeIndex get(const std::string& file, int time_col, const TimeParser& time_parser);
+
+            int size() const { return static_cast<int>(entries_.size()); }
+            const Entry& entry(int k) const { return entries_[k]; }
+
+            // Entry to start from, so that at least `history` rows before the first row at or after
+            // time are read. -1 if the file has no rows or is not sorted.
+            int find(const ptime& time, int history) const;
+            // Whether entry k is at the same line of both files, so they can be seeked together.
+            bool aligned(const TimeIndex& other, int k) const {
+                return k < 0 || (k < other.size() && other.entries_[k].line == entries_[k].line);
+            }
+            // Move reader to entry k, or to the first row after header if k < 0.
+            void seek(CSVReader& reader, int k) const;
+
+        private:
+            static constexpr char magic_[8] = { 'B', 'K', 'T', 'I', 'N', 'D', 'E', 'X' };
+            static constexpr uint64_t version_ = 1;
+
+            void build_(const std::string& file, int time_col, const TimeParser& time_parser);
+            bool load_(const std::string& file, const std::string& manifest);
+            void save_(const std::string& file, const std::string& manifest) const;
+
+            std::vector<Entry> entries_;
+        };
+
+        inline TimeIndex TimeIndex::get(const std::string& file, int time_col,
+            const TimeParser& time_parser) {
+            auto stamp = util::file_stamp(file);
+            std::string manifest = fmt::format("{}|{}\ntime: {} {}\nstride: {}\n", stamp.size,
+                stamp.mtime, time_col, time_parser.key(), stride);
+            std::string index_file = file + extension;
+
+            TimeIndex index;
+            if (!index.load_(index_file, manifest)) {
+                index.build_(file, time_col, time_parser);
+                index.save_(index_file, manifest);
+            }
+            return index;
+        }
+
+        inline int TimeIndex::find(const ptime& time, int history) const {
+            if (entries_.empty()) {
+                return -1;
+            }
+            auto it = std::lower_bound(entries_.begin(), entries_.end(), util::to_epoch_us(time),
+                [](const Entry& e, int64_t t) { return e.time < t; });
+            // The first row at or after time is after entry k, go back enough entries for history.
+            int k = static_cast<int>(it - entries_.begin()) - 1;
+            k -= (history + stride - 1) / stride;
+            return std::max(k, 0);
+        }
+
+        inline void TimeIndex::seek(CSVReader& reader, int k) const {
+            if (k < 0) {
+                reader.rewind();
+                reader.read_row(); // Header.
+            }
+            else {
+                reader.seek(entries_[k].offset, entries_[k].line);
+            }
+        }
+
+        inline void TimeIndex::build_(const std::string& file, int time_col,
+            const TimeParser& time_parser) {
+            entries_.clear();
+            CSVReader reader(file);
+            reader.select_columns({ time_col });
+            reader.read_row(); // Header.
+
+            int64_t last = std::numeric_limits<int64_t>::min();
+            for (std::size_t row = 0;; ++row) {
+                std::size_t offset = reader.offset(), line = reader.line_number();
+                if (!reader.read_row() || reader.row().empty()) {
+                    break;
+                }
+                int64_t time = util::to_epoch_us(time_parser.parse(reader.row()[0]));
+                if (time < last) {
+                    print(fg(fmt::color::yellow), "{} is not sorted by time, it is always read from "
+                        "the beginning.\n", file);
+                    entries_.clear();
+                    break;
+                }
+                last = time;
+                if (row % stride == 0) {
+                    entries_.push_back({ time, offset, line });
+                }
+            }
+        }
+
+        inline bool TimeIndex::load_(const std::string& file, const std::string& manifest) {
+            std::ifstream f(file, std::ios::binary);
+            if (!f) {
+                return false;
+            }
+            std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+            std::size_t pos = 0;
+            auto take = [&](void* dest, std::size_t n) {
+                if (pos + n > content.size()) {
+                    return false;
+                }
+                std::memcpy(dest, content.data() + pos, n);
+                pos += n;
+                return true;
+            };
+
+            char magic[sizeof(magic_)];
+            uint64_t version = 0, manifest_size = 0, count = 0;
+            if (!take(magic, sizeof(magic)) || std::memcmp(magic, magic_, sizeof(magic_)) != 0 ||
+                !take(&version, sizeof(version)) || version != version_ ||
+                !take(&manifest_size, sizeof(manifest_size)) || manifest_size != manifest.size() ||
+                content.compare(pos, manifest_size, manifest) != 0) {
+                return false;
+            }
+            pos += manifest_size;
+            if (!take(&count, sizeof(count)) || content.size() - pos != count * sizeof(Entry)) {
+                return false;
+            }
+            entries_.resize(count);
+            return take(entries_.data(), count * sizeof(Entry));
+        }
+
+        inline void TimeIndex::save_(const std::string& file, const std::string& manifest) const {
+            // Keep extension of temporary file, so it is not taken as a data file.
+            std::string tmp_file = file + ".tmp" + extension;
+            std::ofstream f(tmp_file, std::ios::binary);
+            if (!f) {
+                return; // Directory is read only, index is rebuilt in next run.
+            }
+            uint64_t manifest_size = manifest.size(), count = entries_.size();
+            f.write(magic_, sizeof(magic_));
+            f.write(reinterpret_cast<const char*>(&version_), sizeof(version_));
+            f.write(reinterpret_cast<const char*>(&manifest_size), sizeof(manifest_size));
+            f.write(manifest.data(), manifest.size());
+            f.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            f.write(reinterpret_cast<const char*>(entries_.data()), count * sizeof(Entry));
+            f.close();
+
+            std::error_code ec;
+            if (f) {
+                std::filesystem::rename(tmp_file, file, ec);
+            }
+            if (!f || ec) {
+                std::filesystem::remove(tmp_file, ec);
+            }
+        }
+    } // namespace feeds
+} // namespace backtradercpp
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace backtradercpp {
+    namespace feeds {
+        struct TimeStrConv {
+            using func_type = std::function<std::string(const std::string&)>;
+
+            //"20100202"
+            static std::string non_delimited_date(const std::string& date_str) {
+                std::string res_date = "0000-00-00 00:00:00";
+                res_date.replace(0, 4, std::string_view{ date_str.data(), 4 });
+                res_date.replace(5, 2, std::string_view{ date_str.data() + 4, 2 });
+                res_date.replace(8, 2, std::string_view{ date_str.data() + 6, 2 });
+                return res_date;
+            }
+            static std::string delimited_date(const std::string& date_str) {
+                std::string res_date = "0000-00-00 00:00:00";
+                res_date.replace(0, 4, std::string_view{ date_str.data(), 4 });
+                res_date.replace(5, 2, std::string_view{ date_str.data() + 5, 2 });
+                res_date.replace(8, 2, std::string_view{ date_str.data() + 8, 2 });
+                return res_date;
+            }
+        };
+
+        // String literal as template parameter.
+        template <std::size_t N> struct FixedString {
+            char data[N]{};
+            constexpr FixedString(const char (&s)[N]) { std::copy_n(s, N, data); }
+            constexpr std::size_t size() const { return N - 1; }
+            constexpr char operator[](std::size_t i) const { return data[i]; }
+            constexpr operator std::string_view() const { return { data, N - 1 }; }
+        };
+
+        // Parse time in a fixed format directly into ptime, e.g. TimeFormat<"%Y-%m-%d %H:%M:%S">.
+        // Supported fields are %Y (4 digits), %m, %d, %H, %M, %S (2 digits), '?' matches any
+        // character and other characters must match exactly. Characters after the format are ignored,
+        // the same as TimeStrConv.
+        template <FixedString Fmt> struct TimeFormat {
+            static constexpr std::string_view format() { return Fmt; }
+
+            // Return false if s doesn't match the format.
+            static bool parse(std::string_view s, boost::posix_time::ptime& res);
+            static boost::posix_time::ptime parse(std::string_view s);
+        };
+
+        // Convert a time string to ptime. It can be constructed from
+        //   nullptr: string is in "2020-01-01 01:00:00" format;
+        //   TimeFormat<...>{}: parse directly;
+        //   a function that converts string to the above format, e.g. TimeStrConv::delimited_date.
+        //     Functions in TimeStrConv are replaced by the equivalent TimeFormat.
+        // Last parsed string is memoized as most rows of different assets have the same time. So a
+        // TimeParser must not be used by several threads at the same time.
+        class TimeParser {
+        public:
+            TimeParser(std::nullptr_t = nullptr) {}
+            template <FixedString Fmt>
+            TimeParser(TimeFormat<Fmt>) : fast_(&TimeFormat<Fmt>::parse), key_(Fmt) {}
+            template <typename F>
+                requires std::is_convertible_v<F, TimeStrConv::func_type> &&
+            (!std::is_same_v<std::decay_t<F>, TimeParser>)
+                TimeParser(F f);
+
+            boost::posix_time::ptime parse(std::string_view s) const;
+            boost::posix_time::ptime operator()(std::string_view s) const { return parse(s); }
+
+            // Identify the format, empty for default format. Custom functions can't be identified.
+            const std::string& key() const { return key_; }
+            // Like key(), but also tells custom functions apart within this process: plain functions by
+            // address, other callables by type.
+            std::string process_key() const;
+
+        private:
+            using fast_type = boost::posix_time::ptime (*)(std::string_view);
+            void set_legacy_(const TimeStrConv::func_type& f);
+
+            fast_type fast_ = nullptr;
+            TimeStrConv::func_type converter_;
+            std::string key_;
+
+            mutable std::string last_str_;
+            mutable boost::posix_time::ptime last_time_;
+            mutable bool has_last_ = false;
+        };
+
+        template <FixedString Fmt>
+        inline bool TimeFormat<Fmt>::parse(std::string_view s, boost::posix_time::ptime& res) {
+            int year = 0, month = 1, day = 1, hour = 0, minute = 0, second = 0;
+            std::size_t pos = 0;
+            auto digits = [&](int n, int& v) {
+                if (pos + n > s.size()) {
+                    return false;
+                }
+                v = 0;
+                for (int k = 0; k < n; ++k) {
+                    char c = s[pos + k];
+                    if (c < '0' || c > '9') {
+                        return false;
+                    }
+                    v = v * 10 + (c - '0');
+                }
+                pos += n;
+                return true;
+            };
+            for (std::size_t i = 0; i < Fmt.size(); ++i) {
+                bool ok = true;
+                if (Fmt[i] == '%' && i + 1 < Fmt.size()) {
+                    switch (Fmt[++i]) {
+                    case 'Y':
+                        ok = digits(4, year);
+                        break;
+                    case 'm':
+                        ok = digits(2, month);
+                        break;
+                    case 'd':
+                        ok = digits(2, day);
+                        break;
+                    case 'H':
+                        ok = digits(2, hour);
+                        break;
+                    case 'M':
+                        ok = digits(2, minute);
+                        break;
+                    case 'S':
+                        ok = digits(2, second);
+                        break;
+                    default:
+                        ok = false;
+                    }
+                }
+                else {
+                    ok = pos < s.size() && (Fmt[i] == '?' || s[pos] == Fmt[i]);
+                    ++pos;
+                }
+                if (!ok) {
+                    return false;
+                }
+            }
+            res = boost::posix_time::ptime(
+                boost::gregorian::date(year, month, day),
+                boost::posix_time::hours(hour) + boost::posix_time::minutes(minute) +
+                boost::posix_time::seconds(second));
+            return true;
+        }
+
+        template <FixedString Fmt>
+        inline boost::posix_time::ptime TimeFormat<Fmt>::parse(std::string_view s) {
+            boost::posix_time::ptime res;
+            if (!parse(s, res)) {
+                throw std::runtime_error("Time " + std::string(s) + " doesn't match format " +
+                    std::string(format()) + ".");
+            }
+            return res;
+        }
+
+        template <typename F>
+            requires std::is_convertible_v<F, TimeStrConv::func_type> &&
+        (!std::is_same_v<std::decay_t<F>, TimeParser>)
+            inline TimeParser::TimeParser(F f) {
+            set_legacy_(TimeStrConv::func_type(f));
+        }
+
+        inline void TimeParser::set_legacy_(const TimeStrConv::func_type& f) {
+            if (!f) {
+                return;
+            }
+            using fp = std::string (*)(const std::string&);
+            const fp* p = f.target<fp>();
+            if (p != nullptr && *p == &TimeStrConv::non_delimited_date) {
+                fast_ = &TimeFormat<"%Y%m%d">::parse;
+                key_ = TimeFormat<"%Y%m%d">::format();
+            }
+            else if (p != nullptr && *p == &TimeStrConv::delimited_date) {
+                // delimited_date doesn't check delimiters.
+                fast_ = &TimeFormat<"%Y?%m?%d">::parse;
+                key_ = TimeFormat<"%Y?%m?%d">::format();
+            }
+            else {
+                converter_ = f;
+                key_ = "function";
+            }
+        }
+
+        inline std::string TimeParser::process_key() const {
+            if (!converter_) {
+                return key_;
+            }
+            using fp = std::string (*)(const std::string&);
+            if (const fp* p = converter_.target<fp>()) {
+                return key_ + " " + std::to_string(reinterpret_cast<std::uintptr_t>(*p));
+            }
+            return key_ + " " + converter_.target_type().name();
+        }
+
+        inline boost::posix_time::ptime TimeParser::parse(std::string_view s) const {
+            if (has_last_ && s == last_str_) {
+                return last_time_;
+            }
+            if (fast_ != nullptr) {
+                last_time_ = fast_(s);
+            }
+            else if (converter_) {
+                last_time_ = boost::posix_time::time_from_string(converter_(std::string(s)));
+            }
+            else {
+                last_time_ = boost::posix_time::time_from_string(std::string(s));
+            }
+            last_str_ = s;
+            has_last_ = true;
+            return last_time_;
+        }
+    } // namespace feeds
+} // namespace backtradercpp
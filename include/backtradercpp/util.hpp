@@ -78,6 +78,28 @@ namespace backtradercpp {
                 std::stoi(s.substr(8, 2)));
         }
 
+        // Microseconds since 1970-01-01, used as time column in binary data files.
+        inline int64_t to_epoch_us(const boost::posix_time::ptime& t) {
+            static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+            return (t - epoch).total_microseconds();
+        }
+        inline boost::posix_time::ptime from_epoch_us(int64_t us) {
+            static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+            return epoch + boost::posix_time::microseconds(us);
+        }
+
+        // Size and modification time of a file, used to detect whether a cached file is stale.
+        struct FileStamp {
+            std::uintmax_t size = 0;
+            int64_t mtime = 0;
+            bool operator==(const FileStamp&) const = default;
+        };
+        inline FileStamp file_stamp(const std::filesystem::path& path) {
+            return { std::filesystem::file_size(path),
+                    static_cast<int64_t>(
+                        std::filesystem::last_write_time(path).time_since_epoch().count()) };
+        }
+
         template <typename T> void reset_ifstream(T& f) {
             f.clear();
             f.seekg(0, std::ios::beg);
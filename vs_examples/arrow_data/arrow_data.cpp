@@ -0,0 +1,36 @@
+// Needs Apache Arrow, build with BK_WITH_ARROW defined and link libarrow.
+#include "../../include/backtradercpp/ArrowData.hpp"
+#include "../../include/backtradercpp/Cerebro.hpp"
+using namespace backtradercpp;
+
+struct BuyLowStrategy : public strategy::GenericStrategy {
+    void run() override {
+        // Buy assets at 6th day.
+        if (time_index() == 5) {
+            for (int j = 0; j < data(0).assets(); ++j) {
+                if (data(0).valid(-1, j)) {
+                    buy(0, j, data(0).open(-1, j), 10);
+                }
+            }
+        }
+    }
+};
+
+void run(const feeds::ArrowPriceData &feed) {
+    Cerebro cerebro;
+    cerebro.add_broker(broker::BaseBroker(100000, 0.0005, 0.001).set_feed(feed));
+    cerebro.add_strategy(std::make_shared<BuyLowStrategy>());
+    cerebro.set_verbose(VerboseLevel::OnlySummary);
+    cerebro.run();
+}
+
+int main() {
+    // Long file: a row per asset and day, without volume column. Other numeric columns, here
+    // pct_change, are extra columns read by data(0).num("pct_change").
+    run(feeds::ArrowPriceData(
+        "../../example_data/Arrow/long.feather",
+        std::array<std::string, 7>{"time", "code", "open", "high", "low", "close", ""}));
+    // Wide file: a row per day and a close column per asset. Dates are strings like "19710104".
+    run(feeds::ArrowPriceData("../../example_data/Arrow/wide.feather", "date",
+                              feeds::TimeStrConv::non_delimited_date));
+}